@@ -0,0 +1,196 @@
+#include "../vr_label_tool.h"
+#include "../pose_trace.h"
+#include "../frame_timing.h"
+#include <cgv/base/node.h>
+#include <cgv/render/drawable.h>
+#include <cgv/gui/application.h>
+#include <cgv/utils/file.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+
+/// benchmark of the slicing pipeline without headset: loads a clip, waits until it is uploaded and replays a controller
+/// pose trace through vr_label_tool::update_slice while the viewer draws the labeler. Without display and gpu run it
+/// under xvfb-run with LIBGL_ALWAYS_SOFTWARE=1, such that mesa renders with llvmpipe.
+class vr_label_bench :
+	public cgv::base::node,
+	public cgv::render::drawable
+{
+protected:
+	enum class phase_enum {
+		load,
+		upload,
+		replay,
+		done
+	};
+	phase_enum phase = phase_enum::load;
+	cgv::data::ref_ptr<vr_label_tool> tool;
+	pose_trace trace;
+	pose_replayer replayer;
+	vr::vr_kit_state replay_state = {};
+	std::chrono::steady_clock::time_point phase_begin;
+	double load_time = 0;
+	double upload_time = 0;
+	uint64_t uploaded_bytes = 0;
+	uint32_t nr_replayed_frames = 0;
+	// clip generated by ffmpeg if no video file is given
+	void generate_clip(const std::string& file_name)
+	{
+		std::ostringstream cmd;
+		cmd << "ffmpeg -y -loglevel error -f lavfi -i testsrc2=size=" << clip_width << "x" << clip_height
+			<< ":rate=30 -frames:v " << clip_frames << " -pix_fmt yuv420p \"" << file_name << "\"";
+		if (std::system(cmd.str().c_str()) != 0)
+			std::cerr << "vr_label_bench: could not run " << cmd.str() << std::endl;
+	}
+	double seconds_since(const std::chrono::steady_clock::time_point& t) const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+	}
+	void start_loading()
+	{
+		frame_timing::enabled = true;
+		std::string file_name = video_file_name;
+		if (file_name.empty()) {
+			file_name = "vr_label_bench_clip.mp4";
+			if (!cgv::utils::file::exists(file_name))
+				generate_clip(file_name);
+		}
+		auto t = std::chrono::steady_clock::now();
+		if (!tool->labeler->open_file(file_name)) {
+			std::cerr << "vr_label_bench: could not open " << file_name << std::endl;
+			phase = phase_enum::done;
+			return;
+		}
+		load_time = seconds_since(t);
+		if (trace_file_name.empty() || !trace.read(trace_file_name)) {
+			if (!trace_file_name.empty())
+				std::cerr << "vr_label_bench: could not read pose trace " << trace_file_name << ", replaying a sweep" << std::endl;
+			trace.create_sweep(nr_sweep_samples, 90.0, tool->labeler->get_position(), 0.5f * tool->labeler->get_extent());
+		}
+		uploaded_bytes = tool->labeler->get_nr_uploaded_bytes();
+		phase_begin = std::chrono::steady_clock::now();
+		phase = phase_enum::upload;
+	}
+	void finish_upload()
+	{
+		if (tool->labeler->is_uploading())
+			return;
+		upload_time = seconds_since(phase_begin);
+		uploaded_bytes = tool->labeler->get_nr_uploaded_bytes() - uploaded_bytes;
+		// percentiles only cover the replay
+		frame_timing::clear();
+		phase_begin = std::chrono::steady_clock::now();
+		replayer.start(trace, real_time);
+		phase = phase_enum::replay;
+	}
+	void replay_sample()
+	{
+		std::vector<pose_trace::key_event> due_events;
+		if (!replayer.advance(replay_state, due_events)) {
+			report();
+			phase = phase_enum::done;
+			if (exit_when_done)
+				cgv::gui::application::quit(0);
+			return;
+		}
+		tool->update_slice(replay_state.controller[1].pose, replayer.get_time());
+		++nr_replayed_frames;
+	}
+	void report()
+	{
+		std::ostringstream os;
+		os << std::fixed << std::setprecision(3);
+		os << "metric,value\n";
+		os << "load_time_ms," << 1000 * load_time << "\n";
+		os << "upload_time_ms," << 1000 * upload_time << "\n";
+		os << "uploaded_mb," << uploaded_bytes / double(1 << 20) << "\n";
+		os << "upload_bandwidth_mb_per_s," << (upload_time > 0 ? uploaded_bytes / double(1 << 20) / upload_time : 0.0) << "\n";
+		os << "replayed_frames," << nr_replayed_frames << "\n";
+		os << "replay_time_ms," << 1000 * seconds_since(phase_begin) << "\n";
+		frame_timing::Section sections[] = { frame_timing::FS_COMPUTE_SLICE, frame_timing::FS_SLICE_GEOMETRY, frame_timing::FS_SLICER_DRAW,
+			frame_timing::FS_SLICER_INIT_FRAME, frame_timing::FS_TEXTURE_UPLOAD, frame_timing::FS_FRAME };
+		for (auto s : sections)
+			for (int gpu = 0; gpu < 2; ++gpu) {
+				if (gpu && (s == frame_timing::FS_COMPUTE_SLICE || s == frame_timing::FS_SLICE_GEOMETRY || s == frame_timing::FS_FRAME))
+					continue;
+				frame_timing::section_statistics stats;
+				frame_timing::compute_statistics(s, gpu != 0, nr_replayed_frames, stats);
+				std::string name = std::string(frame_timing::get_section_name(s)) + (gpu ? "_gpu" : "_cpu");
+				os << name << "_p50_ms," << stats.p50 << "\n" << name << "_p95_ms," << stats.p95 << "\n" << name << "_p99_ms," << stats.p99 << "\n";
+			}
+		std::cout << os.str() << std::flush;
+		if (!report_file_name.empty()) {
+			std::ofstream file(report_file_name);
+			file << os.str();
+			if (!file)
+				std::cerr << "vr_label_bench: could not write " << report_file_name << std::endl;
+		}
+		if (!timing_file_name.empty())
+			frame_timing::write_chrome_trace(timing_file_name);
+	}
+public:
+	/// clip to load, which is generated with ffmpeg if empty
+	std::string video_file_name;
+	uint32_t clip_width = 640;
+	uint32_t clip_height = 360;
+	uint32_t clip_frames = 150;
+	/// recorded pose trace to replay, a synthetic sweep is replayed if empty
+	std::string trace_file_name;
+	uint32_t nr_sweep_samples = 900;
+	/// replay at the speed of the recording instead of one pose per frame
+	bool real_time = false;
+	/// metrics written as csv and samples written as chrome trace json
+	std::string report_file_name = "vr_label_bench.csv";
+	std::string timing_file_name = "vr_label_bench.json";
+	bool exit_when_done = true;
+
+	vr_label_bench() : cgv::base::node("vr_label_bench")
+	{
+		// the tool registers its labeler, which the viewer draws, but the tool itself is only driven by the benchmark
+		tool = new vr_label_tool();
+	}
+	std::string get_type_name() const
+	{
+		return "vr_label_bench";
+	}
+	bool self_reflect(cgv::reflect::reflection_handler& rh)
+	{
+		return
+			rh.reflect_member("video_file_name", video_file_name) &&
+			rh.reflect_member("clip_width", clip_width) &&
+			rh.reflect_member("clip_height", clip_height) &&
+			rh.reflect_member("clip_frames", clip_frames) &&
+			rh.reflect_member("trace_file_name", trace_file_name) &&
+			rh.reflect_member("nr_sweep_samples", nr_sweep_samples) &&
+			rh.reflect_member("real_time", real_time) &&
+			rh.reflect_member("report_file_name", report_file_name) &&
+			rh.reflect_member("timing_file_name", timing_file_name) &&
+			rh.reflect_member("exit_when_done", exit_when_done);
+	}
+	void init_frame(cgv::render::context&)
+	{
+		frame_timing::begin_frame();
+		frame_timing::collect_gpu();
+		switch (phase) {
+		case phase_enum::load: start_loading(); break;
+		case phase_enum::upload: finish_upload(); break;
+		case phase_enum::replay: replay_sample(); break;
+		case phase_enum::done: return;
+		}
+		// keep rendering frames until the benchmark is done
+		post_redraw();
+	}
+	void draw(cgv::render::context&)
+	{
+	}
+	void clear(cgv::render::context&)
+	{
+		frame_timing::clear_gpu();
+	}
+};
+
+#include <cgv/base/register.h>
+cgv::base::object_registration<vr_label_bench> vr_label_bench_reg("vr_label_bench");
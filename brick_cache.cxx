@@ -0,0 +1,70 @@
+#include "brick_cache.h"
+
+brick_cache::brick_cache()
+{
+}
+
+void brick_cache::set_store(const brick_store* _store)
+{
+	clear();
+	store = _store;
+}
+
+void brick_cache::set_budget(size_t bytes)
+{
+	budget = bytes;
+	evict(0);
+}
+
+void brick_cache::evict(size_t extra_bytes)
+{
+	while (!lru.empty() && memory_usage + extra_bytes > budget) {
+		auto iter = entries.find(lru.back());
+		memory_usage -= iter->second.data.size();
+		entries.erase(iter);
+		lru.pop_back();
+	}
+}
+
+const uint8_t* brick_cache::get_brick(size_t bi)
+{
+	auto iter = entries.find(bi);
+	if (iter != entries.end()) {
+		++nr_hits;
+		lru.splice(lru.begin(), lru, iter->second.lru_pos);
+		return iter->second.data.data();
+	}
+	if (!store || !store->has_brick(bi))
+		return 0;
+	++nr_misses;
+	size_t brick_size = store->get_brick_size();
+	evict(brick_size);
+	entry& e = entries[bi];
+	e.data.resize(brick_size);
+	if (!store->read_brick(bi, e.data.data())) {
+		entries.erase(bi);
+		return 0;
+	}
+	lru.push_front(bi);
+	e.lru_pos = lru.begin();
+	memory_usage += brick_size;
+	return e.data.data();
+}
+
+void brick_cache::invalidate(size_t bi)
+{
+	auto iter = entries.find(bi);
+	if (iter == entries.end())
+		return;
+	memory_usage -= iter->second.data.size();
+	lru.erase(iter->second.lru_pos);
+	entries.erase(iter);
+}
+
+void brick_cache::clear()
+{
+	entries.clear();
+	lru.clear();
+	memory_usage = 0;
+	nr_hits = nr_misses = 0;
+}
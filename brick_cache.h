@@ -0,0 +1,40 @@
+#pragma once
+
+#include "brick_store.h"
+#include <list>
+#include <unordered_map>
+
+/// least recently used cache of bricks read from a brick_store, bounded by a memory budget
+class brick_cache
+{
+	struct entry
+	{
+		std::vector<uint8_t> data;
+		std::list<size_t>::iterator lru_pos;
+	};
+	const brick_store* store = 0;
+	size_t budget = size_t(2048) << 20;
+	size_t memory_usage = 0;
+	// brick indices with most recently used brick at front
+	std::list<size_t> lru;
+	std::unordered_map<size_t, entry> entries;
+	size_t nr_hits = 0;
+	size_t nr_misses = 0;
+	// drop least recently used bricks until extra_bytes fit into budget
+	void evict(size_t extra_bytes);
+public:
+	brick_cache();
+	void set_store(const brick_store* _store);
+	/// set memory budget in bytes, evicts bricks if necessary
+	void set_budget(size_t bytes);
+	size_t get_budget() const { return budget; }
+	/// return pointer to brick data, reading it from the store on a miss; returns 0 if brick is not stored yet
+	const uint8_t* get_brick(size_t bi);
+	/// drop brick from cache, i.e. after it has been rewritten in the store
+	void invalidate(size_t bi);
+	void clear();
+	size_t get_memory_usage() const { return memory_usage; }
+	size_t get_nr_cached_bricks() const { return entries.size(); }
+	size_t get_nr_hits() const { return nr_hits; }
+	size_t get_nr_misses() const { return nr_misses; }
+};
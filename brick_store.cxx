@@ -0,0 +1,174 @@
+#include "brick_store.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	const char brick_store_magic[4] = { 'V', 'L', 'B', 'S' };
+	const uint32_t brick_store_version = 1;
+	// size of magic, version and layout in bytes
+	const uint64_t header_size = 4 + 4 + 8 * 4;
+}
+
+bool brick_store::layout::operator == (const layout& M) const
+{
+	return frame_width == M.frame_width && frame_height == M.frame_height &&
+		frame_offset == M.frame_offset && frame_count == M.frame_count &&
+		brick_width == M.brick_width && brick_height == M.brick_height && brick_depth == M.brick_depth &&
+		voxel_size == M.voxel_size;
+}
+
+brick_store::brick_store()
+{
+}
+
+brick_store::~brick_store()
+{
+	close();
+}
+
+bool brick_store::open(const std::string& _file_name, const layout& _L)
+{
+	close();
+	std::lock_guard<std::mutex> lock(file_mutex);
+	L = _L;
+	nr_bricks[0] = (L.frame_width + L.brick_width - 1) / L.brick_width;
+	nr_bricks[1] = (L.frame_height + L.brick_height - 1) / L.brick_height;
+	nr_bricks[2] = (L.frame_count + L.brick_depth - 1) / L.brick_depth;
+	written.assign(get_nr_bricks(), 0);
+	// bricks start at the next 4k boundary after header and written flags
+	data_offset = (header_size + written.size() + 4095) / 4096 * 4096;
+	file_name = _file_name;
+
+	// try to reuse existing store
+	file.open(file_name, std::ios::in | std::ios::out | std::ios::binary);
+	if (file.is_open()) {
+		char magic[4];
+		uint32_t version;
+		layout M;
+		uint32_t* fields[8] = { &M.frame_width, &M.frame_height, &M.frame_offset, &M.frame_count, &M.brick_width, &M.brick_height, &M.brick_depth, &M.voxel_size };
+		file.read(magic, 4);
+		file.read(reinterpret_cast<char*>(&version), 4);
+		for (auto f : fields)
+			file.read(reinterpret_cast<char*>(f), 4);
+		if (file && std::equal(magic, magic + 4, brick_store_magic) && version == brick_store_version && M == L) {
+			file.read(reinterpret_cast<char*>(written.data()), written.size());
+			if (file)
+				return true;
+			std::fill(written.begin(), written.end(), 0);
+		}
+		file.close();
+	}
+	// create new store
+	file.open(file_name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "brick_store: could not create " << file_name << std::endl;
+		return false;
+	}
+	const uint32_t fields[8] = { L.frame_width, L.frame_height, L.frame_offset, L.frame_count, L.brick_width, L.brick_height, L.brick_depth, L.voxel_size };
+	file.write(brick_store_magic, 4);
+	file.write(reinterpret_cast<const char*>(&brick_store_version), 4);
+	file.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+	file.write(reinterpret_cast<const char*>(written.data()), written.size());
+	file.flush();
+	return bool(file);
+}
+
+void brick_store::close()
+{
+	std::lock_guard<std::mutex> lock(file_mutex);
+	if (file.is_open())
+		file.close();
+	written.clear();
+	nr_bricks[0] = nr_bricks[1] = nr_bricks[2] = 0;
+}
+
+bool brick_store::is_open() const
+{
+	std::lock_guard<std::mutex> lock(file_mutex);
+	return file.is_open();
+}
+
+size_t brick_store::get_brick_size() const
+{
+	return size_t(L.brick_width) * L.brick_height * L.brick_depth * L.voxel_size;
+}
+
+size_t brick_store::get_brick_index(uint32_t bx, uint32_t by, uint32_t bz) const
+{
+	return bx + size_t(nr_bricks[0]) * (by + size_t(nr_bricks[1]) * bz);
+}
+
+bool brick_store::has_brick(size_t bi) const
+{
+	std::lock_guard<std::mutex> lock(file_mutex);
+	return bi < written.size() && written[bi] != 0;
+}
+
+bool brick_store::has_layer(uint32_t bz) const
+{
+	for (uint32_t by = 0; by < nr_bricks[1]; ++by)
+		for (uint32_t bx = 0; bx < nr_bricks[0]; ++bx)
+			if (!has_brick(get_brick_index(bx, by, bz)))
+				return false;
+	return true;
+}
+
+bool brick_store::read_brick(size_t bi, uint8_t* data) const
+{
+	std::lock_guard<std::mutex> lock(file_mutex);
+	if (bi >= written.size() || !written[bi])
+		return false;
+	file.seekg(std::streamoff(data_offset + bi * get_brick_size()));
+	file.read(reinterpret_cast<char*>(data), get_brick_size());
+	if (!file) {
+		file.clear();
+		return false;
+	}
+	return true;
+}
+
+bool brick_store::write_brick(size_t bi, const uint8_t* data)
+{
+	std::lock_guard<std::mutex> lock(file_mutex);
+	if (bi >= written.size() || !file.is_open())
+		return false;
+	file.seekp(std::streamoff(data_offset + bi * get_brick_size()));
+	file.write(reinterpret_cast<const char*>(data), get_brick_size());
+	// mark brick as written only after its data is in the file
+	written[bi] = 1;
+	file.seekp(std::streamoff(header_size + bi));
+	file.write(reinterpret_cast<const char*>(&written[bi]), 1);
+	file.flush();
+	if (!file) {
+		file.clear();
+		written[bi] = 0;
+		return false;
+	}
+	return true;
+}
+
+bool brick_store::write_layer(uint32_t bz, const uint8_t* frames, uint32_t nr_frames)
+{
+	nr_frames = std::min(nr_frames, L.brick_depth);
+	size_t frame_row_size = size_t(L.frame_width) * L.voxel_size;
+	size_t frame_size = frame_row_size * L.frame_height;
+	size_t brick_row_size = size_t(L.brick_width) * L.voxel_size;
+	std::vector<uint8_t> brick(get_brick_size());
+	for (uint32_t by = 0; by < nr_bricks[1]; ++by) {
+		uint32_t y0 = by * L.brick_height;
+		uint32_t nr_rows = std::min(L.brick_height, L.frame_height - y0);
+		for (uint32_t bx = 0; bx < nr_bricks[0]; ++bx) {
+			uint32_t x0 = bx * L.brick_width;
+			size_t row_size = size_t(std::min(L.brick_width, L.frame_width - x0)) * L.voxel_size;
+			std::fill(brick.begin(), brick.end(), 0);
+			for (uint32_t t = 0; t < nr_frames; ++t)
+				for (uint32_t y = 0; y < nr_rows; ++y)
+					std::memcpy(&brick[(size_t(t) * L.brick_height + y) * brick_row_size],
+						frames + t * frame_size + (y0 + y) * frame_row_size + size_t(x0) * L.voxel_size, row_size);
+			if (!write_brick(get_brick_index(bx, by, bz), brick.data()))
+				return false;
+		}
+	}
+	return true;
+}
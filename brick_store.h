@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <cstdint>
+
+/// file backed store of a video volume split into bricks of brick_width x brick_height pixels over brick_depth frames
+class brick_store
+{
+public:
+	/// geometry of the stored volume, used to validate an existing store file
+	struct layout
+	{
+		uint32_t frame_width = 0;
+		uint32_t frame_height = 0;
+		uint32_t frame_offset = 0;
+		uint32_t frame_count = 0;
+		uint32_t brick_width = 256;
+		uint32_t brick_height = 256;
+		uint32_t brick_depth = 64;
+		uint32_t voxel_size = 3;
+		bool operator == (const layout& L) const;
+	};
+protected:
+	layout L;
+	uint32_t nr_bricks[3] = { 0, 0, 0 };
+	// file offset of first brick
+	uint64_t data_offset = 0;
+	// per brick flag whether brick has been written, mirrored in the file header
+	std::vector<uint8_t> written;
+	mutable std::fstream file;
+	mutable std::mutex file_mutex;
+	std::string file_name;
+public:
+	brick_store();
+	~brick_store();
+	/// open store file and reuse its bricks if the layout matches, otherwise (re)create it
+	bool open(const std::string& file_name, const layout& L);
+	void close();
+	bool is_open() const;
+	const layout& get_layout() const { return L; }
+	/// return number of bricks along x, y or time axis
+	uint32_t get_nr_bricks(int axis) const { return nr_bricks[axis]; }
+	size_t get_nr_bricks() const { return size_t(nr_bricks[0]) * nr_bricks[1] * nr_bricks[2]; }
+	/// size of one brick in bytes
+	size_t get_brick_size() const;
+	size_t get_brick_index(uint32_t bx, uint32_t by, uint32_t bz) const;
+	bool has_brick(size_t bi) const;
+	/// check whether all bricks of the brick layer bz are stored
+	bool has_layer(uint32_t bz) const;
+	bool read_brick(size_t bi, uint8_t* data) const;
+	bool write_brick(size_t bi, const uint8_t* data);
+	/// split up to brick_depth consecutive frames of the brick layer bz into bricks and write them; missing frames and pixels outside of the volume are set to zero
+	bool write_layer(uint32_t bz, const uint8_t* frames, uint32_t nr_frames);
+};
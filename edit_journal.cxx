@@ -0,0 +1,106 @@
+#include "edit_journal.h"
+
+void edit_journal::clear_redo_edits()
+{
+	for (const auto& r : redo_edits)
+		memory_usage -= r.memory_usage;
+	redo_edits.clear();
+}
+
+void edit_journal::enforce_budget()
+{
+	// the open label edit at the back is never dropped
+	size_t nr_closed = undo_edits.size() - (label_edit_open ? 1 : 0);
+	while (memory_usage > memory_budget && nr_closed > 0) {
+		memory_usage -= undo_edits.front().memory_usage;
+		undo_edits.pop_front();
+		--nr_closed;
+	}
+}
+
+label_volume::change_record& edit_journal::begin_label_edit()
+{
+	if (label_edit_open)
+		end_label_edit();
+	edit e;
+	e.kind = EK_LABELS;
+	undo_edits.push_back(std::move(e));
+	label_edit_open = true;
+	return undo_edits.back().labels;
+}
+
+void edit_journal::end_label_edit()
+{
+	if (!label_edit_open)
+		return;
+	label_edit_open = false;
+	edit& e = undo_edits.back();
+	if (e.labels.empty()) {
+		undo_edits.pop_back();
+		return;
+	}
+	// redo history is only lost once an edit actually changed labels
+	clear_redo_edits();
+	e.labels.finish();
+	e.memory_usage = sizeof(edit) + e.labels.get_memory_usage();
+	memory_usage += e.memory_usage;
+	enforce_budget();
+}
+
+void edit_journal::record_slice_creation(size_t index, const vec3& origin, const vec3& direction)
+{
+	end_label_edit();
+	edit e;
+	e.kind = EK_CREATE_SLICE;
+	e.slice_index = index;
+	e.slice_origin = origin;
+	e.slice_direction = direction;
+	e.memory_usage = sizeof(edit);
+	memory_usage += e.memory_usage;
+	clear_redo_edits();
+	undo_edits.push_back(std::move(e));
+	enforce_budget();
+}
+
+void edit_journal::record_slice_deletion(size_t index, const vec3& origin, const vec3& direction)
+{
+	end_label_edit();
+	edit e;
+	e.kind = EK_DELETE_SLICE;
+	e.slice_index = index;
+	e.slice_origin = origin;
+	e.slice_direction = direction;
+	e.memory_usage = sizeof(edit);
+	memory_usage += e.memory_usage;
+	clear_redo_edits();
+	undo_edits.push_back(std::move(e));
+	enforce_budget();
+}
+
+edit_journal::edit* edit_journal::undo()
+{
+	end_label_edit();
+	if (undo_edits.empty())
+		return 0;
+	redo_edits.push_back(std::move(undo_edits.back()));
+	undo_edits.pop_back();
+	return &redo_edits.back();
+}
+
+edit_journal::edit* edit_journal::redo()
+{
+	end_label_edit();
+	if (redo_edits.empty())
+		return 0;
+	undo_edits.push_back(std::move(redo_edits.back()));
+	redo_edits.pop_back();
+	return &undo_edits.back();
+}
+
+void edit_journal::clear()
+{
+	label_edit_open = false;
+	undo_edits.clear();
+	redo_edits.clear();
+	memory_usage = 0;
+}
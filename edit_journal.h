@@ -0,0 +1,61 @@
+#pragma once
+
+#include "label_volume.h"
+#include <cgv/math/fvec.h>
+#include <deque>
+#include <cstddef>
+
+/// undo and redo history of label and slice edits; label edits keep the run length encoded rows they changed,
+/// slice edits keep the slice, and the oldest edits are dropped once the history exceeds its memory budget
+class edit_journal
+{
+public:
+	typedef cgv::math::fvec<float, 3> vec3;
+	enum edit_kind
+	{
+		EK_LABELS,
+		EK_CREATE_SLICE,
+		EK_DELETE_SLICE
+	};
+	struct edit
+	{
+		edit_kind kind;
+		// rows changed by a label edit, restoring them toggles between undone and redone state
+		label_volume::change_record labels;
+		// created or deleted slice
+		size_t slice_index = 0;
+		vec3 slice_origin;
+		vec3 slice_direction;
+		// memory accounted for in the budget when the edit was recorded
+		size_t memory_usage = 0;
+	};
+protected:
+	std::deque<edit> undo_edits;
+	std::deque<edit> redo_edits;
+	// label edit that is still recording
+	bool label_edit_open = false;
+	size_t memory_usage = 0;
+	void clear_redo_edits();
+	void enforce_budget();
+public:
+	/// maximum memory used by all edits in bytes
+	size_t memory_budget = size_t(256) << 20;
+
+	/// start label edit and return its record, which stays valid until end_label_edit
+	label_volume::change_record& begin_label_edit();
+	/// finish label edit, which is dropped if nothing changed
+	void end_label_edit();
+	bool is_label_edit_open() const { return label_edit_open; }
+	/// record slice edit, which ends an open label edit and thereby invalidates its record; callers that still
+	/// write to the record must end the label edit themselves first
+	void record_slice_creation(size_t index, const vec3& origin, const vec3& direction);
+	void record_slice_deletion(size_t index, const vec3& origin, const vec3& direction);
+	/// move last edit to redo history and return it for reverting, or 0 if there is none
+	edit* undo();
+	/// move last undone edit back to undo history and return it for applying again, or 0 if there is none
+	edit* redo();
+	void clear();
+	size_t get_nr_undo_edits() const { return undo_edits.size(); }
+	size_t get_nr_redo_edits() const { return redo_edits.size(); }
+	size_t get_memory_usage() const { return memory_usage; }
+};
@@ -0,0 +1,139 @@
+#include "frame_prefetcher.h"
+
+frame_prefetcher::frame_prefetcher(unsigned nr_workers)
+{
+	for (unsigned i = 0; i < nr_workers; ++i)
+		workers.push_back(std::thread(&frame_prefetcher::decode_chunks, this));
+}
+
+frame_prefetcher::~frame_prefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop_workers = true;
+	}
+	cond.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+void frame_prefetcher::decode_chunks()
+{
+	for (;;) {
+		request r;
+		decode_function f;
+		uint64_t g;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this] { return stop_workers || !queue.empty(); });
+			if (stop_workers)
+				return;
+			r = queue.front();
+			queue.pop_front();
+			f = decode;
+			g = generation;
+		}
+		cgv::media::volume::volume chunk;
+		bool success = f && f(r.frame_begin, r.nr_frames, chunk);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (g == generation) {
+				pending.erase(r.frame_begin);
+				if (success)
+					chunks[r.frame_begin] = chunk;
+			}
+		}
+		cond.notify_all();
+	}
+}
+
+void frame_prefetcher::set_decoder(decode_function _decode)
+{
+	clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	decode = _decode;
+}
+
+void frame_prefetcher::request_chunk(uint32_t frame_begin, uint32_t nr_frames)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pending.find(frame_begin) != pending.end() || chunks.find(frame_begin) != chunks.end())
+			return;
+		pending[frame_begin] = nr_frames;
+		queue.push_back({ frame_begin, nr_frames });
+	}
+	cond.notify_all();
+}
+
+bool frame_prefetcher::take_chunk(uint32_t frame_begin, uint32_t nr_frames, cgv::media::volume::volume& chunk)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto pi = pending.find(frame_begin);
+	if (pi != pending.end() && pi->second == nr_frames) {
+		// still queued chunks are decoded by caller
+		for (auto qi = queue.begin(); qi != queue.end(); ++qi)
+			if (qi->frame_begin == frame_begin) {
+				queue.erase(qi);
+				pending.erase(pi);
+				++nr_misses;
+				return false;
+			}
+		// wait for worker that already decodes the chunk
+		uint64_t g = generation;
+		cond.wait(lock, [&] { return stop_workers || g != generation || pending.find(frame_begin) == pending.end(); });
+	}
+	auto ci = chunks.find(frame_begin);
+	if (ci == chunks.end() || ci->second.get_dimensions()(2) < int(nr_frames)) {
+		++nr_misses;
+		return false;
+	}
+	chunk = ci->second;
+	chunks.erase(ci);
+	++nr_hits;
+	return true;
+}
+
+void frame_prefetcher::retain(uint32_t frame_begin, uint32_t frame_end)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto qi = queue.begin(); qi != queue.end(); ) {
+		if (qi->frame_begin + qi->nr_frames <= frame_begin || qi->frame_begin >= frame_end) {
+			pending.erase(qi->frame_begin);
+			qi = queue.erase(qi);
+		}
+		else
+			++qi;
+	}
+	for (auto ci = chunks.begin(); ci != chunks.end(); ) {
+		if (ci->first + uint32_t(ci->second.get_dimensions()(2)) <= frame_begin || ci->first >= frame_end)
+			ci = chunks.erase(ci);
+		else
+			++ci;
+	}
+}
+
+void frame_prefetcher::clear()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++generation;
+		queue.clear();
+		pending.clear();
+		chunks.clear();
+		nr_hits = nr_misses = 0;
+	}
+	cond.notify_all();
+}
+
+size_t frame_prefetcher::get_queue_depth() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending.size();
+}
+
+size_t frame_prefetcher::get_nr_prefetched_chunks() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return chunks.size();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cgv/media/volume/volume.h>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+/// pool of worker threads that decode chunks of frames ahead of time and keep them until they are taken
+class frame_prefetcher
+{
+public:
+	/// decode nr_frames frames starting at absolute frame frame_begin into chunk
+	typedef std::function<bool(uint32_t frame_begin, uint32_t nr_frames, cgv::media::volume::volume& chunk)> decode_function;
+protected:
+	struct request
+	{
+		uint32_t frame_begin;
+		uint32_t nr_frames;
+	};
+	decode_function decode;
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	bool stop_workers = false;
+	// increased by clear such that workers drop results of outdated requests
+	uint64_t generation = 0;
+	std::deque<request> queue;
+	// chunks that are being decoded and chunks ready to be taken, both indexed by first frame
+	std::map<uint32_t, uint32_t> pending;
+	std::map<uint32_t, cgv::media::volume::volume> chunks;
+	size_t nr_hits = 0;
+	size_t nr_misses = 0;
+	void decode_chunks();
+public:
+	frame_prefetcher(unsigned nr_workers = 2);
+	~frame_prefetcher();
+	/// set function used by workers for decoding, drops all prefetched chunks
+	void set_decoder(decode_function _decode);
+	/// queue decoding of nr_frames frames starting at frame_begin if not queued or decoded before
+	void request_chunk(uint32_t frame_begin, uint32_t nr_frames);
+	/// move prefetched chunk starting at frame_begin into chunk and count a hit; wait if it is currently decoded; count a miss otherwise
+	bool take_chunk(uint32_t frame_begin, uint32_t nr_frames, cgv::media::volume::volume& chunk);
+	/// drop queued requests and decoded chunks outside of frames [frame_begin, frame_end)
+	void retain(uint32_t frame_begin, uint32_t frame_end);
+	/// drop all queued requests and decoded chunks
+	void clear();
+	/// number of chunks queued or being decoded
+	size_t get_queue_depth() const;
+	size_t get_nr_prefetched_chunks() const;
+	size_t get_nr_hits() const { return nr_hits; }
+	size_t get_nr_misses() const { return nr_misses; }
+};
@@ -0,0 +1,70 @@
+#include "frame_range_set.h"
+#include <algorithm>
+
+void frame_range_set::add(uint32_t begin, uint32_t end)
+{
+	if (begin >= end)
+		return;
+	// find first range that could overlap or touch [begin, end)
+	auto iter = ranges.upper_bound(begin);
+	if (iter != ranges.begin() && std::prev(iter)->second >= begin)
+		--iter;
+	// absorb all overlapping or touching ranges
+	while (iter != ranges.end() && iter->first <= end) {
+		begin = std::min(begin, iter->first);
+		end = std::max(end, iter->second);
+		nr_frames -= iter->second - iter->first;
+		iter = ranges.erase(iter);
+	}
+	ranges[begin] = end;
+	nr_frames += end - begin;
+}
+
+void frame_range_set::remove(uint32_t begin, uint32_t end)
+{
+	if (begin >= end)
+		return;
+	auto iter = ranges.upper_bound(begin);
+	if (iter != ranges.begin() && std::prev(iter)->second > begin)
+		--iter;
+	while (iter != ranges.end() && iter->first < end) {
+		uint32_t b = iter->first, e = iter->second;
+		nr_frames -= e - b;
+		iter = ranges.erase(iter);
+		// keep parts outside of removed range
+		if (b < begin) {
+			ranges[b] = begin;
+			nr_frames += begin - b;
+		}
+		if (e > end) {
+			ranges[end] = e;
+			nr_frames += e - end;
+			break;
+		}
+	}
+}
+
+bool frame_range_set::pop_front(uint32_t max_count, uint32_t& begin, uint32_t& end)
+{
+	if (ranges.empty() || max_count == 0)
+		return false;
+	auto iter = ranges.begin();
+	begin = iter->first;
+	end = std::min(iter->second, begin + max_count);
+	remove(begin, end);
+	return true;
+}
+
+bool frame_range_set::contains(uint32_t frame) const
+{
+	auto iter = ranges.upper_bound(frame);
+	if (iter == ranges.begin())
+		return false;
+	return std::prev(iter)->second > frame;
+}
+
+void frame_range_set::clear()
+{
+	ranges.clear();
+	nr_frames = 0;
+}
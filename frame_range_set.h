@@ -0,0 +1,28 @@
+#pragma once
+
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+/// set of disjoint half open frame ranges [begin, end), adjacent or overlapping ranges are merged
+class frame_range_set
+{
+	// map from range begin to range end
+	std::map<uint32_t, uint32_t> ranges;
+	uint64_t nr_frames = 0;
+public:
+	/// add range [begin, end)
+	void add(uint32_t begin, uint32_t end);
+	/// remove range [begin, end)
+	void remove(uint32_t begin, uint32_t end);
+	/// extract up to max_count frames from the front of the first range; returns false if set is empty
+	bool pop_front(uint32_t max_count, uint32_t& begin, uint32_t& end);
+	/// check whether frame is contained
+	bool contains(uint32_t frame) const;
+	bool empty() const { return ranges.empty(); }
+	void clear();
+	/// total number of frames in all ranges
+	uint64_t get_nr_frames() const { return nr_frames; }
+	size_t get_nr_ranges() const { return ranges.size(); }
+	const std::map<uint32_t, uint32_t>& get_ranges() const { return ranges; }
+};
@@ -0,0 +1,298 @@
+#include "frame_timing.h"
+#include <cgv_gl/gl/gl.h>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace frame_timing {
+
+std::atomic<bool> enabled{ false };
+
+namespace {
+
+struct sample
+{
+	// odd while the sample is written, otherwise twice the index of the sample plus two
+	std::atomic<uint64_t> sequence{ 0 };
+	uint64_t begin;
+	uint64_t duration;
+	uint32_t frame;
+	Section section;
+	bool gpu;
+};
+
+struct sample_data
+{
+	uint64_t begin;
+	uint64_t duration;
+	uint32_t frame;
+	Section section;
+	bool gpu;
+};
+
+const size_t ring_size = 16384;
+sample ring[ring_size];
+std::atomic<uint64_t> write_index{ 0 };
+std::atomic<uint32_t> frame_index{ 0 };
+std::atomic<uint64_t> frame_begin{ 0 };
+const auto start_time = std::chrono::steady_clock::now();
+// gpu results arrive this many frames late at most, later ones are missing in the percentiles
+const uint32_t gpu_latency = 4;
+
+const char* section_names[nr_sections] = { "slicer_init_frame", "slicer_draw", "compute_slice", "pressable_draw", "texture_upload", "slice_geometry", "frame" };
+
+void write_sample(Section section, bool gpu, uint32_t frame, uint64_t begin, uint64_t duration)
+{
+	uint64_t i = write_index.fetch_add(1, std::memory_order_relaxed);
+	sample& s = ring[i % ring_size];
+	s.sequence.store(2 * i + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s.begin = begin;
+	s.duration = duration;
+	s.frame = frame;
+	s.section = section;
+	s.gpu = gpu;
+	s.sequence.store(2 * i + 2, std::memory_order_release);
+}
+
+// copy consistent samples held in the ring buffer from oldest to newest
+void collect_samples(std::vector<sample_data>& samples)
+{
+	uint64_t end = write_index.load(std::memory_order_acquire);
+	uint64_t begin = end > ring_size ? end - ring_size : 0;
+	samples.reserve(size_t(end - begin));
+	for (uint64_t i = begin; i < end; ++i) {
+		const sample& s = ring[i % ring_size];
+		uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+		// skip samples that are written or already overwritten by newer ones
+		if (sequence != 2 * i + 2)
+			continue;
+		sample_data d = { s.begin, s.duration, s.frame, s.section, s.gpu };
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s.sequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+		samples.push_back(d);
+	}
+}
+
+double percentile(std::vector<double>& values, double p)
+{
+	size_t i = std::min(size_t(p * values.size()), values.size() - 1);
+	std::nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+struct gpu_query
+{
+	GLuint begin_query;
+	GLuint end_query;
+	Section section;
+	uint32_t frame;
+	uint64_t cpu_begin;
+};
+// queries are only touched from the render thread
+std::vector<gpu_query> open_queries;
+std::deque<gpu_query> pending_queries;
+std::vector<GLuint> free_queries;
+
+GLuint allocate_query()
+{
+	if (free_queries.empty()) {
+		GLuint q;
+		glGenQueries(1, &q);
+		return q;
+	}
+	GLuint q = free_queries.back();
+	free_queries.pop_back();
+	return q;
+}
+
+}
+
+const char* get_section_name(unsigned i)
+{
+	return i < nr_sections ? section_names[i] : "";
+}
+
+uint64_t now()
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+void begin_frame()
+{
+	uint64_t t = now();
+	uint64_t previous = frame_begin.exchange(t, std::memory_order_relaxed);
+	if (previous != 0 && enabled.load(std::memory_order_relaxed))
+		record(FS_FRAME, false, previous, t - previous);
+	frame_index.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t get_frame_index()
+{
+	return frame_index.load(std::memory_order_relaxed);
+}
+
+void record(Section section, bool gpu, uint64_t begin, uint64_t duration)
+{
+	write_sample(section, gpu, get_frame_index(), begin, duration);
+}
+
+namespace {
+
+void compute_statistics(const std::vector<sample_data>& samples, Section section, bool gpu, uint32_t nr_frames, section_statistics& stats)
+{
+	stats = section_statistics();
+	// frames that ended while recording, where gpu results are only complete for older frames
+	uint32_t end = get_frame_index();
+	if (gpu)
+		end = end > gpu_latency ? end - gpu_latency : 0;
+	uint32_t begin = end > nr_frames ? end - nr_frames : 0;
+	std::vector<double> sums(end - begin, -1.0);
+	for (const auto& s : samples)
+		if (s.section == FS_FRAME && !s.gpu && s.frame >= begin && s.frame < end)
+			sums[s.frame - begin] = 0;
+	// sections that did not run in a recorded frame count with zero time
+	for (const auto& s : samples)
+		if (s.section == section && s.gpu == gpu && s.frame >= begin && s.frame < end && sums[s.frame - begin] >= 0)
+			sums[s.frame - begin] += s.duration * 1e-6;
+	sums.erase(std::remove(sums.begin(), sums.end(), -1.0), sums.end());
+	if (sums.empty())
+		return;
+	stats.nr_frames = uint32_t(sums.size());
+	stats.p50 = percentile(sums, 0.50);
+	stats.p95 = percentile(sums, 0.95);
+	stats.p99 = percentile(sums, 0.99);
+}
+
+}
+
+void compute_statistics(Section section, bool gpu, uint32_t nr_frames, section_statistics& stats)
+{
+	std::vector<sample_data> samples;
+	collect_samples(samples);
+	compute_statistics(samples, section, gpu, nr_frames, stats);
+}
+
+std::string get_statistics_text(uint32_t nr_frames)
+{
+	std::vector<sample_data> samples;
+	collect_samples(samples);
+	std::ostringstream os;
+	os << "ms p50/p95/p99   cpu              gpu";
+	os << std::fixed << std::setprecision(2);
+	for (unsigned i = 0; i < nr_sections; ++i) {
+		section_statistics cpu, gpu;
+		compute_statistics(samples, Section(i), false, nr_frames, cpu);
+		os << "\n" << std::left << std::setw(18) << section_names[i] << std::right
+			<< cpu.p50 << "/" << cpu.p95 << "/" << cpu.p99;
+		if (i == FS_COMPUTE_SLICE || i == FS_SLICE_GEOMETRY || i == FS_FRAME)
+			continue;
+		compute_statistics(samples, Section(i), true, nr_frames, gpu);
+		os << "  " << gpu.p50 << "/" << gpu.p95 << "/" << gpu.p99;
+	}
+	return os.str();
+}
+
+bool write_csv(const std::string& file_name)
+{
+	std::ofstream os(file_name);
+	if (!os.is_open())
+		return false;
+	std::vector<sample_data> samples;
+	collect_samples(samples);
+	os << "section,device,frame,begin_ms,duration_ms\n" << std::fixed << std::setprecision(6);
+	for (const auto& s : samples)
+		os << section_names[s.section] << "," << (s.gpu ? "gpu" : "cpu") << "," << s.frame << ","
+			<< s.begin * 1e-6 << "," << s.duration * 1e-6 << "\n";
+	return bool(os);
+}
+
+bool write_chrome_trace(const std::string& file_name)
+{
+	std::ofstream os(file_name);
+	if (!os.is_open())
+		return false;
+	std::vector<sample_data> samples;
+	collect_samples(samples);
+	// gpu events are placed at the cpu time their queries were issued
+	os << "{\"traceEvents\": [\n"
+		<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"cpu\"}},\n"
+		<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"gpu\"}}";
+	os << std::fixed << std::setprecision(3);
+	for (const auto& s : samples)
+		os << ",\n{\"name\": \"" << section_names[s.section] << "\", \"cat\": \"" << (s.gpu ? "gpu" : "cpu")
+			<< "\", \"ph\": \"X\", \"ts\": " << s.begin * 1e-3 << ", \"dur\": " << s.duration * 1e-3
+			<< ", \"pid\": 1, \"tid\": " << (s.gpu ? 2 : 1) << ", \"args\": {\"frame\": " << s.frame << "}}";
+	os << "\n],\n\"displayTimeUnit\": \"ms\"\n}\n";
+	return bool(os);
+}
+
+void clear()
+{
+	for (auto& s : ring)
+		s.sequence.store(0, std::memory_order_relaxed);
+}
+
+void begin_gpu(Section section)
+{
+	gpu_query q = { allocate_query(), 0, section, get_frame_index(), now() };
+	glQueryCounter(q.begin_query, GL_TIMESTAMP);
+	open_queries.push_back(q);
+}
+
+void end_gpu(Section section)
+{
+	// scoped timers close queries in reverse order
+	for (size_t i = open_queries.size(); i-- > 0; ) {
+		if (open_queries[i].section != section)
+			continue;
+		gpu_query q = open_queries[i];
+		open_queries.erase(open_queries.begin() + i);
+		q.end_query = allocate_query();
+		glQueryCounter(q.end_query, GL_TIMESTAMP);
+		pending_queries.push_back(q);
+		return;
+	}
+}
+
+void collect_gpu()
+{
+	// queries finish in order, so stop at the first one without result
+	while (!pending_queries.empty()) {
+		gpu_query& q = pending_queries.front();
+		GLint available = 0;
+		glGetQueryObjectiv(q.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(q.begin_query, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(q.end_query, GL_QUERY_RESULT, &end);
+		// result is attributed to the frame that issued the queries
+		write_sample(q.section, true, q.frame, q.cpu_begin, end > begin ? end - begin : 0);
+		free_queries.push_back(q.begin_query);
+		free_queries.push_back(q.end_query);
+		pending_queries.pop_front();
+	}
+}
+
+void clear_gpu()
+{
+	for (const auto& q : open_queries)
+		glDeleteQueries(1, &q.begin_query);
+	for (const auto& q : pending_queries) {
+		glDeleteQueries(1, &q.begin_query);
+		glDeleteQueries(1, &q.end_query);
+	}
+	if (!free_queries.empty())
+		glDeleteQueries(GLsizei(free_queries.size()), free_queries.data());
+	open_queries.clear();
+	pending_queries.clear();
+	free_queries.clear();
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+/// per frame cpu and gpu timings of the sections of the vr loop; samples go to a lock free ring buffer from which
+/// rolling percentiles are computed and which can be written to csv or chrome trace json files
+namespace frame_timing {
+
+enum Section
+{
+	FS_SLICER_INIT_FRAME,
+	FS_SLICER_DRAW,
+	FS_COMPUTE_SLICE,
+	FS_PRESSABLE_DRAW,
+	FS_TEXTURE_UPLOAD,
+	FS_SLICE_GEOMETRY,
+	FS_FRAME
+};
+
+const unsigned nr_sections = 7;
+const char* get_section_name(unsigned i);
+
+/// whether samples are recorded, which is checked once per timer
+extern std::atomic<bool> enabled;
+
+/// nanoseconds since program start
+uint64_t now();
+/// advance frame index attached to new samples and record the cpu time of the past frame as FS_FRAME
+void begin_frame();
+uint32_t get_frame_index();
+/// append sample to the ring buffer, which can be called concurrently from any thread without locking
+void record(Section section, bool gpu, uint64_t begin, uint64_t duration);
+
+/// percentiles in milliseconds of the per frame sums of a section over the most recent frames
+struct section_statistics
+{
+	uint32_t nr_frames = 0;
+	double p50 = 0, p95 = 0, p99 = 0;
+};
+void compute_statistics(Section section, bool gpu, uint32_t nr_frames, section_statistics& stats);
+/// multi line text with cpu and gpu percentiles of all sections
+std::string get_statistics_text(uint32_t nr_frames);
+
+/// write samples held in the ring buffer as section,device,frame,begin_ms,duration_ms lines
+bool write_csv(const std::string& file_name);
+/// write samples held in the ring buffer as complete events for chrome://tracing, with cpu and gpu on separate tracks
+bool write_chrome_trace(const std::string& file_name);
+/// drop all samples
+void clear();
+
+/// gpu timestamp queries of the current opengl context, which are read back without stalling a few frames later
+void begin_gpu(Section section);
+void end_gpu(Section section);
+/// record results of finished queries, called once per frame from the render thread
+void collect_gpu();
+/// delete all queries, must be called with the context current
+void clear_gpu();
+
+/// cpu time of scope
+class scoped_timer
+{
+	Section section;
+	uint64_t begin;
+	bool active;
+public:
+	scoped_timer(Section _section) : section(_section), active(enabled.load(std::memory_order_relaxed)) { begin = active ? now() : 0; }
+	~scoped_timer() { if (active) record(section, false, begin, now() - begin); }
+};
+
+/// cpu and gpu time of scope, only to be used on the render thread
+class scoped_gpu_timer
+{
+	Section section;
+	uint64_t begin;
+	bool active;
+public:
+	scoped_gpu_timer(Section _section) : section(_section), active(enabled.load(std::memory_order_relaxed))
+	{
+		if (!active)
+			return;
+		begin = now();
+		begin_gpu(section);
+	}
+	~scoped_gpu_timer()
+	{
+		if (!active)
+			return;
+		end_gpu(section);
+		record(section, false, begin, now() - begin);
+	}
+};
+
+}
+
+#define VL_TIME_CONCAT_(a, b) a##b
+#define VL_TIME_CONCAT(a, b) VL_TIME_CONCAT_(a, b)
+/// time cpu of enclosing scope as section, i.e. VL_TIME_SCOPE(frame_timing::FS_COMPUTE_SLICE)
+#define VL_TIME_SCOPE(section) frame_timing::scoped_timer VL_TIME_CONCAT(frame_timer_, __LINE__)(section)
+/// time cpu and gpu of enclosing scope on the render thread
+#define VL_TIME_GPU_SCOPE(section) frame_timing::scoped_gpu_timer VL_TIME_CONCAT(frame_timer_, __LINE__)(section)
@@ -0,0 +1,242 @@
+#include "label_exporter.h"
+#include <cgv/media/image/image_writer.h>
+#include <cgv/utils/dir.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+std::string label_exporter::get_mask_file_name(uint32_t f)
+{
+	std::ostringstream os;
+	os << "masks/frame_" << std::setw(6) << std::setfill('0') << f << ".png";
+	return os.str();
+}
+
+void label_exporter::compute_boxes(const label_volume& labels, uint32_t f, std::vector<box>& boxes)
+{
+	if (!labels.has_labels(f))
+		return;
+	std::map<label_volume::label_type, box> frame_boxes;
+	for (uint32_t y = 0; y < labels.get_height(); ++y) {
+		for (const auto& r : *labels.get_row(f, y)) {
+			auto bi = frame_boxes.find(r.label);
+			if (bi == frame_boxes.end()) {
+				frame_boxes[r.label] = { f, r.label, r.begin, y, uint32_t(r.end - 1), y, uint64_t(r.end - r.begin) };
+				continue;
+			}
+			box& b = bi->second;
+			b.x_min = std::min(b.x_min, uint32_t(r.begin));
+			b.x_max = std::max(b.x_max, uint32_t(r.end - 1));
+			b.y_max = y;
+			b.area += r.end - r.begin;
+		}
+	}
+	for (const auto& b : frame_boxes)
+		boxes.push_back(b.second);
+}
+
+bool label_exporter::write_mask(const label_volume& labels, uint32_t f, bool wide, std::vector<uint8_t>& buffer, const std::string& file_name) const
+{
+	size_t nr_pixels = size_t(labels.get_width()) * labels.get_height();
+	buffer.resize(nr_pixels * sizeof(label_volume::label_type));
+	label_volume::label_type* dense = reinterpret_cast<label_volume::label_type*>(buffer.data());
+	labels.extract_frame(f, dense);
+	if (!wide) {
+		// narrow in place, writing never overtakes reading
+		for (size_t i = 0; i < nr_pixels; ++i)
+			buffer[i] = uint8_t(dense[i]);
+	}
+	cgv::data::data_format df(labels.get_width(), labels.get_height(), wide ? cgv::type::info::TI_UINT16 : cgv::type::info::TI_UINT8, cgv::data::CF_L);
+	cgv::data::const_data_view dv(&df, buffer.data());
+	cgv::media::image::image_writer writer(file_name);
+	return writer.write_image(dv);
+}
+
+bool label_exporter::write_mot_tracks(const std::vector<std::vector<box>>& boxes, const std::string& file_name) const
+{
+	std::ofstream os(file_name);
+	if (!os.is_open())
+		return false;
+	// MOT frames are counted from one and track ids are the labels
+	for (const auto& frame_boxes : boxes)
+		for (const auto& b : frame_boxes)
+			os << b.frame + 1 << "," << b.label << "," << b.x_min << "," << b.y_min << ","
+				<< b.x_max - b.x_min + 1 << "," << b.y_max - b.y_min + 1 << ",1,-1,-1,-1\n";
+	return bool(os);
+}
+
+bool label_exporter::write_coco_annotations(const std::vector<std::vector<box>>& boxes, uint32_t frame_begin, uint32_t width, uint32_t height, const std::string& file_name) const
+{
+	std::ofstream os(file_name);
+	if (!os.is_open())
+		return false;
+	std::vector<label_volume::label_type> used_labels;
+	os << "{\n\"images\": [";
+	bool first = true;
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		// skipped frames have no mask
+		if (write_masks && skip_empty_frames && boxes[i].empty())
+			continue;
+		uint32_t f = frame_begin + uint32_t(i);
+		os << (first ? "\n" : ",\n") << "{\"id\": " << f << ", \"file_name\": \"" << get_mask_file_name(f)
+			<< "\", \"width\": " << width << ", \"height\": " << height << ", \"frame_index\": " << f << "}";
+		first = false;
+	}
+	os << "\n],\n\"annotations\": [";
+	size_t id = 0;
+	for (const auto& frame_boxes : boxes)
+		for (const auto& b : frame_boxes) {
+			os << (id == 0 ? "\n" : ",\n") << "{\"id\": " << id + 1 << ", \"image_id\": " << b.frame << ", \"category_id\": " << b.label
+				<< ", \"track_id\": " << b.label << ", \"bbox\": [" << b.x_min << ", " << b.y_min << ", " << b.x_max - b.x_min + 1 << ", "
+				<< b.y_max - b.y_min + 1 << "], \"area\": " << b.area << ", \"iscrowd\": 0}";
+			++id;
+			used_labels.push_back(b.label);
+		}
+	std::sort(used_labels.begin(), used_labels.end());
+	used_labels.erase(std::unique(used_labels.begin(), used_labels.end()), used_labels.end());
+	os << "\n],\n\"categories\": [";
+	for (size_t i = 0; i < used_labels.size(); ++i)
+		os << (i == 0 ? "\n" : ",\n") << "{\"id\": " << used_labels[i] << ", \"name\": \"label_" << used_labels[i] << "\"}";
+	os << "\n]\n}\n";
+	return bool(os);
+}
+
+bool label_exporter::create_directories(const std::string& directory) const
+{
+	if (!cgv::utils::dir::exists(directory))
+		cgv::utils::dir::mkdir(directory);
+	if (write_masks && !cgv::utils::dir::exists(directory + "/masks") && !cgv::utils::dir::mkdir(directory + "/masks")) {
+		std::cerr << "label_exporter: could not create " << directory << "/masks" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool label_exporter::write_frames(const label_volume& labels, uint32_t frame_begin, uint32_t frame_end, bool wide, const std::string& directory,
+	std::vector<std::vector<box>>& boxes, uint32_t boxes_frame_begin) const
+{
+	std::atomic<uint32_t> next_frame(frame_begin);
+	std::atomic<bool> success(true);
+	// threads take frames one by one and keep only the mask of the current frame
+	auto export_frames = [&]() {
+		std::vector<uint8_t> buffer;
+		for (uint32_t f = next_frame++; f < frame_end; f = next_frame++) {
+			compute_boxes(labels, f, boxes[f - boxes_frame_begin]);
+			if (!write_masks || (skip_empty_frames && !labels.has_labels(f)))
+				continue;
+			if (!write_mask(labels, f, wide, buffer, directory + "/" + get_mask_file_name(f))) {
+				success = false;
+				return;
+			}
+		}
+	};
+	unsigned n = nr_threads > 0 ? nr_threads : std::max(std::thread::hardware_concurrency(), 1u);
+	n = std::min(n, frame_end - frame_begin);
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < n; ++i)
+		threads.push_back(std::thread(export_frames));
+	export_frames();
+	for (auto& t : threads)
+		t.join();
+	if (!success)
+		std::cerr << "label_exporter: could not write masks to " << directory << "/masks" << std::endl;
+	return success;
+}
+
+bool label_exporter::export_labels(const label_volume& labels, uint32_t frame_begin, uint32_t frame_end, const std::string& directory)
+{
+	if (frame_begin >= frame_end || !create_directories(directory))
+		return false;
+	std::vector<std::vector<box>> boxes(frame_end - frame_begin);
+	if (!write_frames(labels, frame_begin, frame_end, labels.get_max_label() > 255, directory, boxes, frame_begin))
+		return false;
+	return write_mot_tracks(boxes, directory + "/tracks.txt") &&
+		write_coco_annotations(boxes, frame_begin, labels.get_width(), labels.get_height(), directory + "/annotations.json");
+}
+
+label_exporter::~label_exporter()
+{
+	cancel();
+}
+
+bool label_exporter::start(label_source source, uint32_t width, uint32_t height, uint32_t frame_begin, uint32_t frame_end,
+	uint32_t batch_frames, bool trim_end, const std::string& directory)
+{
+	cancel();
+	if (frame_begin >= frame_end || batch_frames == 0)
+		return false;
+	cancelled = false;
+	succeeded = false;
+	nr_exported_frames = 0;
+	nr_frames = frame_end - frame_begin;
+	running = true;
+	export_thread = std::thread(&label_exporter::export_batches, this, source, width, height, frame_begin, frame_end, batch_frames, trim_end, directory);
+	return true;
+}
+
+void label_exporter::cancel()
+{
+	cancelled = true;
+	if (export_thread.joinable())
+		export_thread.join();
+	running = false;
+}
+
+float label_exporter::get_progress() const
+{
+	uint32_t n = nr_frames;
+	return n > 0 ? float(nr_exported_frames) / n : 0.0f;
+}
+
+void label_exporter::export_batches(label_source source, uint32_t width, uint32_t height, uint32_t frame_begin, uint32_t frame_end,
+	uint32_t batch_frames, bool trim_end, std::string directory)
+{
+	// masks of all frames need the same bit depth and the end may depend on the last labeled frame, both of which
+	// are only known after a first pass over the batches, which is cheap compared to writing masks
+	label_volume::label_type max_label = 0;
+	uint32_t labeled_end = frame_begin;
+	for (uint32_t b = frame_begin; b < frame_end && !cancelled; b += batch_frames) {
+		label_volume batch;
+		batch.set_dimensions(width, height);
+		uint32_t e = std::min(b + batch_frames, frame_end);
+		if (!source(b, e, batch)) {
+			running = false;
+			return;
+		}
+		max_label = std::max(max_label, batch.get_max_label());
+		std::vector<uint32_t> frames = batch.get_labeled_frames();
+		auto last = std::lower_bound(frames.begin(), frames.end(), e);
+		if (last != frames.begin())
+			labeled_end = std::max(labeled_end, *(last - 1) + 1);
+	}
+	if (trim_end)
+		frame_end = labeled_end;
+	if (cancelled || frame_begin >= frame_end || !create_directories(directory)) {
+		running = false;
+		return;
+	}
+	nr_frames = frame_end - frame_begin;
+	std::vector<std::vector<box>> boxes(frame_end - frame_begin);
+	for (uint32_t b = frame_begin; b < frame_end; b += batch_frames) {
+		if (cancelled) {
+			running = false;
+			return;
+		}
+		label_volume batch;
+		batch.set_dimensions(width, height);
+		uint32_t e = std::min(b + batch_frames, frame_end);
+		if (!source(b, e, batch) || !write_frames(batch, b, e, max_label > 255, directory, boxes, frame_begin)) {
+			running = false;
+			return;
+		}
+		nr_exported_frames = e - frame_begin;
+	}
+	succeeded = write_mot_tracks(boxes, directory + "/tracks.txt") &&
+		write_coco_annotations(boxes, frame_begin, width, height, directory + "/annotations.json");
+	running = false;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "label_volume.h"
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/// export of the labels of a frame range to one png mask per frame together with per frame bounding boxes of all
+/// labels as MOT tracks and COCO annotations; frames are distributed over a pool of threads that each only expand
+/// the frame they are writing. Exports can run in a background thread that takes the labels batch by batch from a
+/// source, such that only one batch of frames is held in memory.
+class label_exporter
+{
+public:
+	/// bounding box [x_min, x_max] x [y_min, y_max] of a label in a frame
+	struct box
+	{
+		uint32_t frame;
+		label_volume::label_type label;
+		uint32_t x_min, y_min;
+		uint32_t x_max, y_max;
+		uint64_t area;
+	};
+	/// decode labels of frames [frame_begin, frame_end) into labels, which is empty and has the frame size; called from
+	/// the export thread
+	typedef std::function<bool(uint32_t frame_begin, uint32_t frame_end, label_volume& labels)> label_source;
+protected:
+	std::thread export_thread;
+	std::atomic<bool> running{ false };
+	std::atomic<bool> cancelled{ false };
+	std::atomic<bool> succeeded{ false };
+	std::atomic<uint32_t> nr_exported_frames{ 0 };
+	std::atomic<uint32_t> nr_frames{ 0 };
+	// export batches from source, run by export_thread
+	void export_batches(label_source source, uint32_t width, uint32_t height, uint32_t frame_begin, uint32_t frame_end,
+		uint32_t batch_frames, bool trim_end, std::string directory);
+	bool create_directories(const std::string& directory) const;
+	// write masks of frames [frame_begin, frame_end) with a pool of threads and append their boxes to boxes, which
+	// holds the boxes of all frames from boxes_frame_begin on
+	bool write_frames(const label_volume& labels, uint32_t frame_begin, uint32_t frame_end, bool wide, const std::string& directory,
+		std::vector<std::vector<box>>& boxes, uint32_t boxes_frame_begin) const;
+	// write labels of frame f as 8 or 16 bit gray image
+	bool write_mask(const label_volume& labels, uint32_t f, bool wide, std::vector<uint8_t>& buffer, const std::string& file_name) const;
+	bool write_mot_tracks(const std::vector<std::vector<box>>& boxes, const std::string& file_name) const;
+	bool write_coco_annotations(const std::vector<std::vector<box>>& boxes, uint32_t frame_begin, uint32_t width, uint32_t height, const std::string& file_name) const;
+public:
+	/// number of writing threads, 0 selects the number of hardware threads
+	unsigned nr_threads = 0;
+	bool write_masks = true;
+	/// write no masks for frames without labels
+	bool skip_empty_frames = false;
+	/// export frames [frame_begin, frame_end) to directory/masks/frame_<index>.png, directory/tracks.txt and directory/annotations.json
+	bool export_labels(const label_volume& labels, uint32_t frame_begin, uint32_t frame_end, const std::string& directory);
+	/// export frames [frame_begin, frame_end) like export_labels in a background thread that takes them from source in
+	/// batches of batch_frames; with trim_end the export ends after the last labeled frame
+	bool start(label_source source, uint32_t width, uint32_t height, uint32_t frame_begin, uint32_t frame_end,
+		uint32_t batch_frames, bool trim_end, const std::string& directory);
+	/// stop background export after the current batch and wait for the thread
+	void cancel();
+	bool is_running() const { return running; }
+	/// fraction of frames of the background export written so far
+	float get_progress() const;
+	/// whether the last finished background export succeeded
+	bool has_succeeded() const { return succeeded; }
+	~label_exporter();
+	/// append bounding boxes of all labels in frame f to boxes, ordered by label
+	static void compute_boxes(const label_volume& labels, uint32_t f, std::vector<box>& boxes);
+	/// name of the mask file of frame f relative to the export directory
+	static std::string get_mask_file_name(uint32_t f);
+};
@@ -0,0 +1,437 @@
+#include "label_file.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+	const char label_file_magic[4] = { 'V', 'L', 'L', 'F' };
+	const uint32_t label_file_version = 1;
+	// size of magic, version, width, height, chunk frames, number of chunks and index offset in bytes
+	const uint64_t header_size = 4 + 4 + 4 * 4 + 8;
+	const uint64_t entry_size = 8 + 4 + 4;
+
+	void write_varint(std::vector<uint8_t>& buffer, uint32_t value)
+	{
+		while (value >= 0x80) {
+			buffer.push_back(uint8_t(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back(uint8_t(value));
+	}
+	bool read_varint(const uint8_t*& ptr, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			if (ptr == end)
+				return false;
+			uint8_t b = *ptr++;
+			value |= uint32_t(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+	void write_index(std::ostream& os, const std::vector<label_file::chunk_entry>& index)
+	{
+		for (const auto& e : index) {
+			os.write(reinterpret_cast<const char*>(&e.offset), 8);
+			os.write(reinterpret_cast<const char*>(&e.size), 4);
+			os.write(reinterpret_cast<const char*>(&e.checksum), 4);
+		}
+	}
+	template <typename T>
+	T read_value(const uint8_t* ptr)
+	{
+		T value;
+		std::memcpy(&value, ptr, sizeof(T));
+		return value;
+	}
+}
+
+label_file::label_file()
+{
+}
+
+label_file::~label_file()
+{
+	close();
+}
+
+uint32_t label_file::compute_checksum(const uint8_t* buffer, size_t size)
+{
+	static uint32_t table[256];
+	static bool table_initialized = [] {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		return true;
+	}();
+	(void)table_initialized;
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+bool label_file::map()
+{
+	unmap();
+#ifdef _WIN32
+	file_handle = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = 0;
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file_handle, &size);
+	data_size = size_t(size.QuadPart);
+	mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping_handle)
+		data = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+#else
+	file_descriptor = ::open(file_name.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+	struct stat st;
+	if (fstat(file_descriptor, &st) == 0) {
+		data_size = size_t(st.st_size);
+		void* ptr = mmap(0, data_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+		if (ptr != MAP_FAILED)
+			data = static_cast<const uint8_t*>(ptr);
+	}
+#endif
+	if (!data) {
+		unmap();
+		return false;
+	}
+	return true;
+}
+
+void label_file::unmap()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle)
+		CloseHandle(file_handle);
+	mapping_handle = file_handle = 0;
+#else
+	if (data)
+		munmap(const_cast<uint8_t*>(data), data_size);
+	if (file_descriptor >= 0)
+		::close(file_descriptor);
+	file_descriptor = -1;
+#endif
+	data = 0;
+	data_size = 0;
+}
+
+bool label_file::create()
+{
+	std::ofstream file(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	const uint32_t fields[5] = { label_file_version, width, height, chunk_frames, 0 };
+	index_offset = header_size;
+	file.write(label_file_magic, 4);
+	file.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+	file.write(reinterpret_cast<const char*>(&index_offset), 8);
+	index.clear();
+	return bool(file);
+}
+
+bool label_file::read_index()
+{
+	if (data_size < header_size || !std::equal(data, data + 4, label_file_magic) || read_value<uint32_t>(data + 4) != label_file_version)
+		return false;
+	if (read_value<uint32_t>(data + 8) != width || read_value<uint32_t>(data + 12) != height) {
+		std::cerr << "label_file: " << file_name << " stores labels of frames with " << read_value<uint32_t>(data + 8) << "x" << read_value<uint32_t>(data + 12) << " pixels" << std::endl;
+		return false;
+	}
+	chunk_frames = read_value<uint32_t>(data + 16);
+	uint32_t nr_chunks = read_value<uint32_t>(data + 20);
+	index_offset = read_value<uint64_t>(data + 24);
+	if (chunk_frames == 0 || index_offset + nr_chunks * entry_size > data_size)
+		return false;
+	index.resize(nr_chunks);
+	for (uint32_t ci = 0; ci < nr_chunks; ++ci) {
+		const uint8_t* entry = data + index_offset + ci * entry_size;
+		index[ci] = { read_value<uint64_t>(entry), read_value<uint32_t>(entry + 8), read_value<uint32_t>(entry + 12) };
+		if (index[ci].offset + index[ci].size > data_size)
+			return false;
+	}
+	return true;
+}
+
+bool label_file::open(const std::string& _file_name, uint32_t _width, uint32_t _height, uint32_t _chunk_frames)
+{
+	close();
+	file_name = _file_name;
+	width = _width;
+	height = _height;
+	chunk_frames = _chunk_frames;
+	std::ifstream probe(file_name, std::ios::binary);
+	bool exists = probe.is_open();
+	probe.close();
+	// never overwrite an existing file that cannot be read
+	if ((exists || create()) && map() && read_index()) {
+		loaded.assign(index.size(), 0);
+		return true;
+	}
+	std::cerr << "label_file: could not open " << file_name << std::endl;
+	close();
+	return false;
+}
+
+void label_file::close()
+{
+	unmap();
+	file_name.clear();
+	index.clear();
+	loaded.clear();
+}
+
+void label_file::encode_chunk(const label_volume& labels, uint32_t ci, std::vector<uint8_t>& buffer) const
+{
+	buffer.clear();
+	// frames, rows and runs are stored as varints of differences to their predecessors
+	std::vector<uint32_t> frames;
+	for (uint32_t i = 0; i < chunk_frames; ++i)
+		if (labels.has_labels(ci * chunk_frames + i))
+			frames.push_back(i);
+	write_varint(buffer, uint32_t(frames.size()));
+	for (uint32_t i : frames) {
+		uint32_t f = ci * chunk_frames + i;
+		write_varint(buffer, i);
+		uint32_t nr_rows = 0;
+		for (uint32_t y = 0; y < height; ++y)
+			if (!labels.get_row(f, y)->empty())
+				++nr_rows;
+		write_varint(buffer, nr_rows);
+		uint32_t prev_y = 0;
+		for (uint32_t y = 0; y < height; ++y) {
+			const auto& row = *labels.get_row(f, y);
+			if (row.empty())
+				continue;
+			write_varint(buffer, y - prev_y);
+			prev_y = y;
+			write_varint(buffer, uint32_t(row.size()));
+			uint32_t prev_end = 0;
+			for (const auto& r : row) {
+				write_varint(buffer, r.begin - prev_end);
+				write_varint(buffer, r.end - r.begin);
+				write_varint(buffer, r.label);
+				prev_end = r.end;
+			}
+		}
+	}
+}
+
+bool label_file::decode_chunk(const uint8_t* buffer, size_t size, uint32_t ci, label_volume& labels) const
+{
+	const uint8_t* ptr = buffer;
+	const uint8_t* end = buffer + size;
+	uint32_t nr_frames;
+	if (!read_varint(ptr, end, nr_frames))
+		return false;
+	for (uint32_t n = 0; n < nr_frames; ++n) {
+		uint32_t i, nr_rows;
+		if (!read_varint(ptr, end, i) || !read_varint(ptr, end, nr_rows) || i >= chunk_frames)
+			return false;
+		uint32_t f = ci * chunk_frames + i;
+		// frames edited before their chunk was loaded keep the edits
+		bool keep = labels.is_unsaved(f);
+		if (!keep)
+			labels.erase_frame(f);
+		uint32_t y = 0;
+		for (uint32_t r = 0; r < nr_rows; ++r) {
+			uint32_t dy, nr_runs;
+			if (!read_varint(ptr, end, dy) || !read_varint(ptr, end, nr_runs))
+				return false;
+			y += dy;
+			uint32_t x = 0;
+			for (uint32_t k = 0; k < nr_runs; ++k) {
+				uint32_t gap, length, label;
+				if (!read_varint(ptr, end, gap) || !read_varint(ptr, end, length) || !read_varint(ptr, end, label))
+					return false;
+				x += gap;
+				if (!keep)
+					labels.paint_span(f, y, x, x + length, label_volume::label_type(label));
+				x += length;
+			}
+		}
+		if (!keep)
+			labels.mark_saved(f);
+	}
+	return ptr == end;
+}
+
+size_t label_file::load(label_volume& labels, uint32_t frame_begin, uint32_t frame_end)
+{
+	if (!is_open() || frame_begin >= frame_end)
+		return 0;
+	size_t nr_decoded = 0;
+	uint32_t ci_end = (frame_end - 1) / chunk_frames + 1;
+	if (loaded.size() < ci_end)
+		loaded.resize(ci_end, 0);
+	for (uint32_t ci = frame_begin / chunk_frames; ci < ci_end; ++ci) {
+		if (loaded[ci])
+			continue;
+		loaded[ci] = 1;
+		if (read_chunk(ci, labels))
+			++nr_decoded;
+	}
+	return nr_decoded;
+}
+
+bool label_file::read_chunk(uint32_t ci, label_volume& labels) const
+{
+	if (ci >= index.size() || index[ci].size == 0)
+		return false;
+	const uint8_t* buffer = data + index[ci].offset;
+	if (compute_checksum(buffer, index[ci].size) != index[ci].checksum) {
+		std::cerr << "label_file: checksum mismatch in chunk " << ci << " of " << file_name << std::endl;
+		return false;
+	}
+	if (!decode_chunk(buffer, index[ci].size, ci, labels))
+		std::cerr << "label_file: could not decode chunk " << ci << " of " << file_name << std::endl;
+	return true;
+}
+
+size_t label_file::read(label_volume& labels, uint32_t frame_begin, uint32_t frame_end) const
+{
+	if (!is_open() || frame_begin >= frame_end)
+		return 0;
+	size_t nr_decoded = 0;
+	for (uint32_t ci = frame_begin / chunk_frames; ci <= (frame_end - 1) / chunk_frames; ++ci)
+		if (read_chunk(ci, labels))
+			++nr_decoded;
+	return nr_decoded;
+}
+
+bool label_file::save(label_volume& labels)
+{
+	if (!is_open())
+		return false;
+	std::vector<uint32_t> chunks;
+	for (uint32_t f : labels.get_unsaved_frames())
+		if (chunks.empty() || chunks.back() != f / chunk_frames)
+			chunks.push_back(f / chunk_frames);
+	if (chunks.empty())
+		return true;
+	// frames of a chunk that were never loaded must not be dropped when rewriting it
+	for (uint32_t ci : chunks)
+		load(labels, ci * chunk_frames, (ci + 1) * chunk_frames);
+	std::vector<std::vector<uint8_t>> buffers(chunks.size());
+	for (size_t i = 0; i < chunks.size(); ++i)
+		encode_chunk(labels, chunks[i], buffers[i]);
+	unmap();
+	std::fstream file(file_name, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "label_file: could not write " << file_name << std::endl;
+		map();
+		return false;
+	}
+	// changed chunks and the new index are appended behind everything the current header refers to, and the header
+	// is only redirected to the new index once both were flushed, such that an interrupted save keeps the last state
+	file.seekp(0, std::ios::end);
+	uint64_t data_end = uint64_t(file.tellp());
+	std::vector<chunk_entry> new_index = index;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		uint32_t ci = chunks[i];
+		if (new_index.size() <= ci)
+			new_index.resize(ci + 1, { 0, 0, 0 });
+		uint32_t size = uint32_t(buffers[i].size());
+		new_index[ci] = { data_end, size, compute_checksum(buffers[i].data(), size) };
+		file.write(reinterpret_cast<const char*>(buffers[i].data()), size);
+		data_end += size;
+	}
+	uint64_t new_index_offset = data_end;
+	write_index(file, new_index);
+	file.flush();
+	if (file) {
+		uint32_t nr_chunks = uint32_t(new_index.size());
+		file.seekp(20);
+		file.write(reinterpret_cast<const char*>(&nr_chunks), 4);
+		file.write(reinterpret_cast<const char*>(&new_index_offset), 8);
+		file.flush();
+	}
+	bool success = bool(file);
+	file.close();
+	if (!map() || !read_index()) {
+		std::cerr << "label_file: could not reopen " << file_name << std::endl;
+		return false;
+	}
+	if (loaded.size() < index.size())
+		loaded.resize(index.size(), 0);
+	if (!success)
+		return false;
+	// replaced chunks and indices stay in the file until they make up most of it
+	uint64_t live_size = header_size + index.size() * entry_size;
+	for (const auto& e : index)
+		live_size += e.size;
+	if (data_size > 2 * live_size + (1 << 20) && !compact())
+		std::cerr << "label_file: could not compact " << file_name << std::endl;
+	std::vector<uint32_t> saved_frames;
+	for (uint32_t f : labels.get_unsaved_frames())
+		if (std::binary_search(chunks.begin(), chunks.end(), f / chunk_frames))
+			saved_frames.push_back(f);
+	for (uint32_t f : saved_frames)
+		labels.mark_saved(f);
+	return true;
+}
+
+bool label_file::compact()
+{
+	// live chunks are copied to a new file, which then replaces the old one at once
+	std::string temp_file_name = file_name + ".tmp";
+	std::vector<chunk_entry> new_index = index;
+	uint64_t offset = header_size;
+	for (auto& e : new_index) {
+		e.offset = e.size > 0 ? offset : 0;
+		offset += e.size;
+	}
+	{
+		std::ofstream file(temp_file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		const uint32_t fields[5] = { label_file_version, width, height, chunk_frames, uint32_t(new_index.size()) };
+		file.write(label_file_magic, 4);
+		file.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+		file.write(reinterpret_cast<const char*>(&offset), 8);
+		for (const auto& e : index)
+			file.write(reinterpret_cast<const char*>(data + e.offset), e.size);
+		write_index(file, new_index);
+		file.flush();
+		if (!file) {
+			file.close();
+			std::remove(temp_file_name.c_str());
+			return false;
+		}
+	}
+	unmap();
+#ifdef _WIN32
+	bool replaced = MoveFileExA(temp_file_name.c_str(), file_name.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool replaced = std::rename(temp_file_name.c_str(), file_name.c_str()) == 0;
+#endif
+	if (!replaced)
+		std::remove(temp_file_name.c_str());
+	return map() && read_index() && replaced;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "label_volume.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/// binary container of the labels of a video, stored next to the video file; frames are grouped into chunks of
+/// chunk_frames consecutive absolute frames that are compressed and checksummed independently, such that a window
+/// of the video only reads the chunks it overlaps from the memory mapped file and saving only appends changed chunks
+class label_file
+{
+public:
+	/// position of a chunk in the file, a chunk of size 0 is empty
+	struct chunk_entry
+	{
+		uint64_t offset;
+		uint32_t size;
+		uint32_t checksum;
+	};
+protected:
+	std::string file_name;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t chunk_frames = 64;
+	uint64_t index_offset = 0;
+	std::vector<chunk_entry> index;
+	// chunks decoded into the label volume since opening
+	std::vector<uint8_t> loaded;
+	// read only mapping of the whole file
+	const uint8_t* data = 0;
+	size_t data_size = 0;
+#ifdef _WIN32
+	void* file_handle = 0;
+	void* mapping_handle = 0;
+#else
+	int file_descriptor = -1;
+#endif
+	bool map();
+	void unmap();
+	// write header and empty index of a new file
+	bool create();
+	// read header and index from mapping
+	bool read_index();
+	// compress labels of frames of chunk ci and decode them again
+	void encode_chunk(const label_volume& labels, uint32_t ci, std::vector<uint8_t>& buffer) const;
+	bool decode_chunk(const uint8_t* buffer, size_t size, uint32_t ci, label_volume& labels) const;
+	// verify and decode chunk ci, returns false for empty or corrupt chunks
+	bool read_chunk(uint32_t ci, label_volume& labels) const;
+	// rewrite file without replaced chunks and indices into a temporary file that replaces it
+	bool compact();
+public:
+	label_file();
+	~label_file();
+	/// open label file for frames of width x height pixels or create it if it does not exist; fails if it exists for other dimensions
+	bool open(const std::string& file_name, uint32_t width, uint32_t height, uint32_t chunk_frames = 64);
+	void close();
+	bool is_open() const { return !file_name.empty(); }
+	const std::string& get_file_name() const { return file_name; }
+	uint32_t get_chunk_frames() const { return chunk_frames; }
+	size_t get_nr_chunks() const { return index.size(); }
+	/// decode chunks overlapping frames [frame_begin, frame_end) that have not been loaded before, keeping frames with unsaved changes; returns number of decoded chunks
+	size_t load(label_volume& labels, uint32_t frame_begin, uint32_t frame_end);
+	/// decode all chunks overlapping frames [frame_begin, frame_end) without tracking them as loaded, i.e. for reading them
+	/// into a temporary volume
+	size_t read(label_volume& labels, uint32_t frame_begin, uint32_t frame_end) const;
+	/// append chunks containing unsaved frames and a new index, switch the header to it and mark the frames as saved
+	bool save(label_volume& labels);
+	/// CRC-32 of size bytes
+	static uint32_t compute_checksum(const uint8_t* buffer, size_t size);
+};
@@ -0,0 +1,318 @@
+#include "label_propagator.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <cstdlib>
+
+label_propagator::label_propagator(unsigned nr_workers)
+{
+	for (unsigned i = 0; i < nr_workers; ++i)
+		workers.push_back(std::thread(&label_propagator::propagate_jobs, this));
+}
+
+label_propagator::~label_propagator()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop_workers = true;
+	}
+	cond.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+bool label_propagator::find_owner(uint32_t f, uint32_t& keyframe) const
+{
+	// keyframes keep their hand made labels
+	if (keyframes.find(f) != keyframes.end())
+		return false;
+	auto next = keyframes.upper_bound(f);
+	bool has_next = next != keyframes.end();
+	bool has_prev = next != keyframes.begin();
+	uint32_t a = has_prev ? std::prev(next)->first : 0;
+	uint32_t b = has_next ? next->first : 0;
+	// frames up to the middle between two keyframes belong to the earlier one
+	bool first_half = !has_next || !has_prev || f <= a + (b - a) / 2;
+	if (has_prev && first_half && f - a <= max_distance) {
+		// owned frames in (a, f] stop propagation
+		auto o = owned_frames.upper_bound(a);
+		if (o != owned_frames.end() && *o <= f)
+			return false;
+		keyframe = a;
+		return true;
+	}
+	if (has_next && (!has_prev || !first_half) && b - f <= max_distance) {
+		// owned frames in [f, b) stop propagation
+		auto o = owned_frames.lower_bound(f);
+		if (o != owned_frames.end() && *o < b)
+			return false;
+		keyframe = b;
+		return true;
+	}
+	return false;
+}
+
+bool label_propagator::is_current(const job& j, uint32_t f) const
+{
+	auto ki = keyframes.find(j.keyframe);
+	uint32_t owner;
+	return j.generation == generation && ki != keyframes.end() && ki->second == j.version && find_owner(f, owner) && owner == j.keyframe;
+}
+
+void label_propagator::propagate_jobs()
+{
+	for (;;) {
+		job j;
+		luma_function f;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this] { return stop_workers || !queue.empty(); });
+			if (stop_workers)
+				return;
+			j = std::move(queue.front());
+			queue.pop_front();
+			f = get_luma;
+			++nr_busy_workers;
+		}
+		std::vector<uint8_t> prev_luma, next_luma;
+		std::vector<label_volume::label_type> next_labels;
+		bool has_prev_luma = false;
+		bool empty = std::all_of(j.labels.begin(), j.labels.end(), [](label_volume::label_type l) { return l == 0; });
+		for (uint32_t frame = j.keyframe + j.direction; ; frame += j.direction) {
+			// stop at the next frame on destruction instead of finishing the job
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (stop_workers || !is_current(j, frame))
+					break;
+			}
+			// once all labels are lost the remaining frames are only cleared
+			if (!empty) {
+				if (!has_prev_luma && !(f && f(frame - j.direction, prev_luma)))
+					break;
+				if (!f(frame, next_luma))
+					break;
+				match_blocks(prev_luma, next_luma, j.labels, next_labels);
+				j.labels.swap(next_labels);
+				prev_luma.swap(next_luma);
+				has_prev_luma = true;
+				empty = std::all_of(j.labels.begin(), j.labels.end(), [](label_volume::label_type l) { return l == 0; });
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (stop_workers || !is_current(j, frame))
+					break;
+				results.push_back({ frame, j.keyframe, j.version, j.labels });
+			}
+			if (frame == j.last_frame)
+				break;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--nr_busy_workers;
+		}
+		cond.notify_all();
+	}
+}
+
+void label_propagator::match_blocks(const std::vector<uint8_t>& prev_luma, const std::vector<uint8_t>& next_luma,
+	const std::vector<label_volume::label_type>& prev_labels, std::vector<label_volume::label_type>& next_labels) const
+{
+	next_labels.assign(size_t(width) * height, 0);
+	int B = int(block_size);
+	int R = int(search_radius);
+	int nr_blocks_x = (int(width) + B - 1) / B;
+	int nr_blocks_y = (int(height) + B - 1) / B;
+	// only blocks within search radius of labeled blocks can receive labels
+	std::vector<uint8_t> labeled(size_t(nr_blocks_x) * nr_blocks_y, 0);
+	for (uint32_t y = 0; y < height; ++y)
+		for (uint32_t x = 0; x < width; ++x)
+			if (prev_labels[size_t(y) * width + x] != 0)
+				labeled[(y / B) * nr_blocks_x + x / B] = 1;
+	int reach = (R + B - 1) / B;
+	for (int by = 0; by < nr_blocks_y; ++by) {
+		for (int bx = 0; bx < nr_blocks_x; ++bx) {
+			bool near_labels = false;
+			for (int ny = std::max(by - reach, 0); ny <= std::min(by + reach, nr_blocks_y - 1) && !near_labels; ++ny)
+				for (int nx = std::max(bx - reach, 0); nx <= std::min(bx + reach, nr_blocks_x - 1); ++nx)
+					if (labeled[ny * nr_blocks_x + nx]) {
+						near_labels = true;
+						break;
+					}
+			if (!near_labels)
+				continue;
+			int x0 = bx * B, y0 = by * B;
+			int x1 = std::min(x0 + B, int(width)), y1 = std::min(y0 + B, int(height));
+			// sum of absolute luma differences of block displaced by (dx,dy) in previous frame, stopping at bound
+			auto sad = [&](int dx, int dy, uint32_t bound) {
+				uint32_t s = 0;
+				for (int y = y0; y < y1 && s < bound; ++y) {
+					const uint8_t* n = &next_luma[size_t(y) * width];
+					const uint8_t* p = &prev_luma[size_t(y + dy) * width + dx];
+					for (int x = x0; x < x1; ++x)
+						s += uint32_t(std::abs(int(n[x]) - int(p[x])));
+				}
+				return s;
+			};
+			// prefer no motion on ties
+			int best_dx = 0, best_dy = 0;
+			uint32_t best_sad = sad(0, 0, std::numeric_limits<uint32_t>::max());
+			for (int dy = -R; dy <= R && best_sad > 0; ++dy) {
+				if (y0 + dy < 0 || y1 + dy > int(height))
+					continue;
+				for (int dx = -R; dx <= R; ++dx) {
+					if ((dx == 0 && dy == 0) || x0 + dx < 0 || x1 + dx > int(width))
+						continue;
+					uint32_t s = sad(dx, dy, best_sad);
+					if (s < best_sad) {
+						best_sad = s;
+						best_dx = dx;
+						best_dy = dy;
+					}
+				}
+			}
+			for (int y = y0; y < y1; ++y)
+				std::copy(&prev_labels[size_t(y + best_dy) * width + x0 + best_dx], &prev_labels[size_t(y + best_dy) * width + x1 + best_dx],
+					&next_labels[size_t(y) * width + x0]);
+		}
+	}
+}
+
+void label_propagator::set_luma_source(luma_function _get_luma, uint32_t _width, uint32_t _height)
+{
+	clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	get_luma = _get_luma;
+	width = _width;
+	height = _height;
+}
+
+void label_propagator::add_keyframe(uint32_t f)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	// outdate running jobs of keyframe and drop queued ones
+	++keyframes[f];
+	propagated_frames.erase(f);
+	owned_frames.erase(f);
+	queue.erase(std::remove_if(queue.begin(), queue.end(), [f](const job& j) { return j.keyframe == f; }), queue.end());
+	edited_keyframes.push_back(f);
+}
+
+bool label_propagator::is_keyframe(uint32_t f) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return keyframes.find(f) != keyframes.end();
+}
+
+void label_propagator::add_owned_frame(uint32_t f)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	propagated_frames.erase(f);
+	owned_frames.insert(f);
+}
+
+void label_propagator::schedule(const label_volume& labels)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::sort(edited_keyframes.begin(), edited_keyframes.end());
+		edited_keyframes.erase(std::unique(edited_keyframes.begin(), edited_keyframes.end()), edited_keyframes.end());
+		for (uint32_t k : edited_keyframes) {
+			auto ki = keyframes.find(k);
+			job j = { k, ki->second, generation, 1, 0, std::vector<label_volume::label_type>(size_t(width) * height) };
+			labels.extract_frame(k, j.labels.data());
+			// forward up to the middle to the next keyframe
+			uint64_t last = uint64_t(k) + max_distance;
+			auto next = std::next(ki);
+			if (next != keyframes.end())
+				last = std::min(last, uint64_t(k) + (next->first - k) / 2);
+			last = std::min(last, uint64_t(std::numeric_limits<uint32_t>::max()));
+			if (last > k) {
+				j.last_frame = uint32_t(last);
+				queue.push_back(j);
+			}
+			// backward down to the frame after the middle to the previous keyframe
+			int64_t first = std::max(int64_t(k) - int64_t(max_distance), int64_t(0));
+			if (ki != keyframes.begin()) {
+				uint32_t a = std::prev(ki)->first;
+				first = std::max(first, int64_t(a) + (k - a) / 2 + 1);
+			}
+			if (first < int64_t(k)) {
+				j.direction = -1;
+				j.last_frame = uint32_t(first);
+				queue.push_back(std::move(j));
+			}
+		}
+		edited_keyframes.clear();
+	}
+	cond.notify_all();
+}
+
+size_t label_propagator::apply_results(label_volume& labels, size_t max_frames)
+{
+	size_t nr_applied = 0;
+	while (nr_applied < max_frames) {
+		result r;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (results.empty())
+				break;
+			r = std::move(results.front());
+			results.pop_front();
+			// frame might have been taken over by a keyframe edited after the result was computed
+			auto ki = keyframes.find(r.keyframe);
+			uint32_t owner;
+			if (ki == keyframes.end() || ki->second != r.version || !find_owner(r.frame, owner) || owner != r.keyframe)
+				continue;
+			// labels that did not come from propagation, e.g. loaded ones, are kept and stop running jobs
+			if (labels.has_labels(r.frame) && propagated_frames.find(r.frame) == propagated_frames.end()) {
+				owned_frames.insert(r.frame);
+				continue;
+			}
+			propagated_frames.insert(r.frame);
+		}
+		labels.set_frame(r.frame, r.labels.data());
+		++nr_applied;
+	}
+	return nr_applied;
+}
+
+bool label_propagator::has_results() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !results.empty();
+}
+
+void label_propagator::cancel()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	++generation;
+	edited_keyframes.clear();
+	queue.clear();
+	results.clear();
+	cond.wait(lock, [this] { return nr_busy_workers == 0; });
+}
+
+void label_propagator::clear()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	keyframes.clear();
+	propagated_frames.clear();
+	owned_frames.clear();
+	edited_keyframes.clear();
+	queue.clear();
+	results.clear();
+	// running jobs stop at their next frame as their keyframe is gone
+	cond.wait(lock, [this] { return nr_busy_workers == 0; });
+}
+
+size_t label_propagator::get_nr_jobs() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return queue.size() + nr_busy_workers;
+}
+
+size_t label_propagator::get_nr_keyframes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return keyframes.size();
+}
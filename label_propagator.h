@@ -0,0 +1,100 @@
+#pragma once
+
+#include "label_volume.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+
+/// pool of worker threads that carry the labels of hand edited keyframes forward and backward through the video by
+/// block matching on luma; every frame between two keyframes is owned by the nearer one, such that editing a keyframe
+/// only recomputes the frames up to the middle to its neighbouring keyframes
+class label_propagator
+{
+public:
+	/// write width x height luma values of absolute frame into luma, return false if the frame is not available
+	typedef std::function<bool(uint32_t frame, std::vector<uint8_t>& luma)> luma_function;
+protected:
+	struct job
+	{
+		uint32_t keyframe;
+		uint64_t version;
+		uint64_t generation;
+		// +1 for forward and -1 for backward propagation through frames up to last_frame
+		int direction;
+		uint32_t last_frame;
+		std::vector<label_volume::label_type> labels;
+	};
+	struct result
+	{
+		uint32_t frame;
+		uint32_t keyframe;
+		uint64_t version;
+		std::vector<label_volume::label_type> labels;
+	};
+	luma_function get_luma;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	bool stop_workers = false;
+	size_t nr_busy_workers = 0;
+	// edit count per keyframe, results of jobs started for an older version are dropped
+	std::map<uint32_t, uint64_t> keyframes;
+	// increased by cancel such that running jobs stop
+	uint64_t generation = 0;
+	// frames whose labels were propagated and may be replaced by later results
+	std::set<uint32_t> propagated_frames;
+	// frames with labels that were neither painted nor propagated, e.g. filled or loaded ones, which propagation neither
+	// overwrites nor passes
+	std::set<uint32_t> owned_frames;
+	// keyframes edited since the last call to schedule
+	std::vector<uint32_t> edited_keyframes;
+	std::deque<job> queue;
+	std::deque<result> results;
+	void propagate_jobs();
+	// compute labels of next frame from labels and luma of previous frame
+	void match_blocks(const std::vector<uint8_t>& prev_luma, const std::vector<uint8_t>& next_luma,
+		const std::vector<label_volume::label_type>& prev_labels, std::vector<label_volume::label_type>& next_labels) const;
+	// find keyframe that owns frame f, which requires that no owned frame lies between them, expects mutex to be locked
+	bool find_owner(uint32_t f, uint32_t& keyframe) const;
+	// check whether results of job for frame f are still wanted, expects mutex to be locked
+	bool is_current(const job& j, uint32_t f) const;
+public:
+	/// edge length of matched blocks in pixels
+	uint32_t block_size = 8;
+	/// maximum displacement of a block between successive frames in pixels
+	uint32_t search_radius = 6;
+	/// maximum number of frames labels are carried away from a keyframe
+	uint32_t max_distance = 30;
+
+	label_propagator(unsigned nr_workers = 2);
+	~label_propagator();
+	/// set source of luma values and frame size, drops all keyframes
+	void set_luma_source(luma_function _get_luma, uint32_t _width, uint32_t _height);
+	/// record that frame f was edited by hand, propagation is started by the next call to schedule
+	void add_keyframe(uint32_t f);
+	bool is_keyframe(uint32_t f) const;
+	/// record that labels of frame f were set by other means than painting, such that propagation keeps them
+	void add_owned_frame(uint32_t f);
+	/// start propagation from the keyframes edited since the last call, taking their labels from labels
+	void schedule(const label_volume& labels);
+	/// write at most max_frames propagated frames into labels and return their number; frames that hold labels which
+	/// were not propagated become owned instead of being overwritten
+	size_t apply_results(label_volume& labels, size_t max_frames = 8);
+	/// check whether propagated frames wait for apply_results
+	bool has_results() const;
+	/// drop queued jobs and results and wait until running jobs stopped, keyframes are kept
+	void cancel();
+	/// drop keyframes, queued jobs and results, and wait until workers no longer access frames
+	void clear();
+	/// number of queued and running jobs
+	size_t get_nr_jobs() const;
+	size_t get_nr_keyframes() const;
+};
@@ -0,0 +1,400 @@
+#include "label_volume.h"
+#include <algorithm>
+#include <cmath>
+
+label_volume::label_volume()
+{
+}
+
+void label_volume::set_dimensions(uint32_t _width, uint32_t _height)
+{
+	width = std::min(_width, uint32_t(UINT16_MAX));
+	height = _height;
+	clear();
+	unsaved_frames.clear();
+}
+
+void label_volume::clear()
+{
+	for (const auto& fi : frames) {
+		for (uint32_t y = 0; y < height; ++y)
+			if (!fi.second.rows[y].empty())
+				record_row(fi.first, y);
+		add_modified_region(fi.first, 0, width, 0, height);
+	}
+	frames.clear();
+	nr_voxels = 0;
+	label_counts.clear();
+	label_frame_counts.clear();
+	label_boxes.clear();
+	boxes_outofdate = false;
+	++version;
+}
+
+void label_volume::add_modified_region(uint32_t f, uint32_t x_begin, uint32_t x_end, uint32_t y_begin, uint32_t y_end)
+{
+	unsaved_frames.insert(f);
+	auto ri = modified_regions.find(f);
+	if (ri == modified_regions.end()) {
+		modified_regions[f] = { x_begin, x_end, y_begin, y_end };
+		return;
+	}
+	region& R = ri->second;
+	R.x_begin = std::min(R.x_begin, x_begin);
+	R.x_end = std::max(R.x_end, x_end);
+	R.y_begin = std::min(R.y_begin, y_begin);
+	R.y_end = std::max(R.y_end, y_end);
+}
+
+void label_volume::count_label(uint32_t f, label_type label, int64_t delta)
+{
+	if (label == 0 || delta == 0)
+		return;
+	if (label >= label_counts.size()) {
+		label_counts.resize(size_t(label) + 1, 0);
+		label_frame_counts.resize(size_t(label) + 1);
+	}
+	label_counts[label] += delta;
+	nr_voxels += delta;
+	// per frame areas are kept only for frames that contain the label, such that the first and last key give its frame span
+	uint64_t& area = label_frame_counts[label][f];
+	area += delta;
+	if (area == 0)
+		label_frame_counts[label].erase(f);
+	boxes_outofdate = true;
+	++version;
+}
+
+void label_volume::record_row(uint32_t f, uint32_t y)
+{
+	if (!recording)
+		return;
+	std::vector<bool>& recorded = recording->recorded_rows[f];
+	if (recorded.empty())
+		recorded.resize(height, false);
+	if (recorded[y])
+		return;
+	recorded[y] = true;
+	const std::vector<run>* row = get_row(f, y);
+	uint32_t nr_runs = row ? uint32_t(row->size()) : 0;
+	recording->rows.push_back({ f, y, uint32_t(recording->runs.size()), nr_runs });
+	if (row)
+		recording->runs.insert(recording->runs.end(), row->begin(), row->end());
+}
+
+void label_volume::restore(change_record& record)
+{
+	change_record* active_record = recording;
+	recording = 0;
+	std::vector<run> current_runs;
+	current_runs.reserve(record.runs.size());
+	for (auto& rc : record.rows) {
+		auto fi = frames.find(rc.frame);
+		if (fi == frames.end()) {
+			if (rc.nr_runs == 0) {
+				rc.run_begin = uint32_t(current_runs.size());
+				continue;
+			}
+			fi = frames.emplace(rc.frame, frame()).first;
+			fi->second.rows.resize(height);
+		}
+		frame& fr = fi->second;
+		std::vector<run>& row = fr.rows[rc.y];
+		for (const auto& r : row) {
+			count_label(rc.frame, r.label, -int64_t(r.end - r.begin));
+			fr.nr_voxels -= r.end - r.begin;
+		}
+		uint32_t run_begin = uint32_t(current_runs.size());
+		uint32_t nr_current_runs = uint32_t(row.size());
+		current_runs.insert(current_runs.end(), row.begin(), row.end());
+		row.assign(record.runs.begin() + rc.run_begin, record.runs.begin() + rc.run_begin + rc.nr_runs);
+		for (const auto& r : row) {
+			count_label(rc.frame, r.label, r.end - r.begin);
+			fr.nr_voxels += r.end - r.begin;
+		}
+		rc.run_begin = run_begin;
+		rc.nr_runs = nr_current_runs;
+		add_modified_region(rc.frame, 0, width, rc.y, rc.y + 1);
+		if (fr.nr_voxels == 0)
+			frames.erase(fi);
+	}
+	record.runs.swap(current_runs);
+	recording = active_record;
+}
+
+void label_volume::paint_span(uint32_t f, uint32_t y, uint32_t x_begin, uint32_t x_end, label_type label)
+{
+	x_end = std::min(x_end, width);
+	if (y >= height || x_begin >= x_end)
+		return;
+	auto fi = frames.find(f);
+	if (fi == frames.end()) {
+		// erasing in unlabeled frame
+		if (label == 0)
+			return;
+		record_row(f, y);
+		fi = frames.emplace(f, frame()).first;
+		fi->second.rows.resize(height);
+	}
+	else
+		record_row(f, y);
+	frame& fr = fi->second;
+	std::vector<run>& row = fr.rows[y];
+	// first run that ends after x_begin
+	auto first = std::lower_bound(row.begin(), row.end(), x_begin, [](const run& r, uint32_t x) { return r.end <= x; });
+	auto last = first;
+	// collect parts of runs overlapped by the span
+	run head = { 0, 0, 0 }, tail = { 0, 0, 0 };
+	int64_t removed = 0;
+	while (last != row.end() && last->begin < x_end) {
+		if (last->begin < x_begin)
+			head = { last->begin, uint16_t(x_begin), last->label };
+		if (last->end > x_end)
+			tail = { uint16_t(x_end), last->end, last->label };
+		uint32_t overlap = std::min(uint32_t(last->end), x_end) - std::max(uint32_t(last->begin), x_begin);
+		count_label(f, last->label, -int64_t(overlap));
+		removed += overlap;
+		++last;
+	}
+	// replace overlapped runs by head, new run and tail and merge neighbors with equal label
+	std::vector<run> middle;
+	if (head.end > head.begin)
+		middle.push_back(head);
+	if (label != 0)
+		middle.push_back({ uint16_t(x_begin), uint16_t(x_end), label });
+	if (tail.end > tail.begin)
+		middle.push_back(tail);
+	size_t pos = first - row.begin();
+	row.erase(first, last);
+	row.insert(row.begin() + pos, middle.begin(), middle.end());
+	size_t merge_begin = pos > 0 ? pos - 1 : 0;
+	size_t merge_end = std::min(pos + middle.size() + 1, row.size());
+	for (size_t i = merge_begin; i + 1 < merge_end; ) {
+		if (row[i].end == row[i + 1].begin && row[i].label == row[i + 1].label) {
+			row[i].end = row[i + 1].end;
+			row.erase(row.begin() + i + 1);
+			--merge_end;
+		}
+		else
+			++i;
+	}
+	int64_t added = label != 0 ? int64_t(x_end - x_begin) : 0;
+	count_label(f, label, added);
+	fr.nr_voxels += added - removed;
+	if (added != 0 || removed != 0)
+		add_modified_region(f, x_begin, x_end, y, y + 1);
+	if (fr.nr_voxels == 0)
+		frames.erase(fi);
+}
+
+void label_volume::paint_disk(uint32_t f, float x, float y, float radius, label_type label)
+{
+	if (radius <= 0)
+		return;
+	int y_begin = std::max(int(std::ceil(y - radius - 0.5f)), 0);
+	int y_end = std::min(int(std::floor(y + radius - 0.5f)) + 1, int(height));
+	for (int yi = y_begin; yi < y_end; ++yi) {
+		// half width of disk at pixel center of row
+		float dy = yi + 0.5f - y;
+		float half_width = std::sqrt(std::max(radius * radius - dy * dy, 0.0f));
+		int x_begin = std::max(int(std::ceil(x - half_width - 0.5f)), 0);
+		int x_end = std::min(int(std::floor(x + half_width - 0.5f)) + 1, int(width));
+		if (x_begin < x_end)
+			paint_span(f, uint32_t(yi), uint32_t(x_begin), uint32_t(x_end), label);
+	}
+}
+
+void label_volume::paint_ellipsoid(float x, float y, float f, float radius_xy, float radius_f, label_type label)
+{
+	if (radius_xy <= 0)
+		return;
+	if (radius_f <= 0) {
+		if (f >= 0)
+			paint_disk(uint32_t(f), x, y, radius_xy, label);
+		return;
+	}
+	int f_begin = std::max(int(std::ceil(f - radius_f - 0.5f)), 0);
+	int f_end = int(std::floor(f + radius_f - 0.5f)) + 1;
+	for (int fi = f_begin; fi < f_end; ++fi) {
+		float df = (fi + 0.5f - f) / radius_f;
+		float r = radius_xy * std::sqrt(std::max(1.0f - df * df, 0.0f));
+		paint_disk(uint32_t(fi), x, y, r, label);
+	}
+}
+
+void label_volume::erase_frame(uint32_t f)
+{
+	auto fi = frames.find(f);
+	if (fi == frames.end())
+		return;
+	for (uint32_t y = 0; y < height; ++y)
+		if (!fi->second.rows[y].empty())
+			record_row(f, y);
+	for (const auto& row : fi->second.rows)
+		for (const auto& r : row)
+			count_label(f, r.label, -int64_t(r.end - r.begin));
+	frames.erase(fi);
+	add_modified_region(f, 0, width, 0, height);
+}
+
+void label_volume::set_frame(uint32_t f, const label_type* labels)
+{
+	erase_frame(f);
+	frame fr;
+	fr.rows.resize(height);
+	for (uint32_t y = 0; y < height; ++y) {
+		const label_type* row = labels + size_t(y) * width;
+		for (uint32_t x = 0; x < width; ) {
+			uint32_t x_end = x + 1;
+			while (x_end < width && row[x_end] == row[x])
+				++x_end;
+			if (row[x] != 0) {
+				if (fr.rows[y].empty())
+					record_row(f, y);
+				fr.rows[y].push_back({ uint16_t(x), uint16_t(x_end), row[x] });
+				count_label(f, row[x], x_end - x);
+				fr.nr_voxels += x_end - x;
+			}
+			x = x_end;
+		}
+	}
+	if (fr.nr_voxels > 0)
+		frames[f] = std::move(fr);
+	add_modified_region(f, 0, width, 0, height);
+}
+
+label_volume::label_type label_volume::get_max_label() const
+{
+	// counts of labels that were erased stay in place with zero voxels
+	for (size_t l = label_counts.size(); l > 1; --l)
+		if (label_counts[l - 1] > 0)
+			return label_type(l - 1);
+	return 0;
+}
+
+label_volume::label_type label_volume::get_label(uint32_t f, uint32_t x, uint32_t y) const
+{
+	const std::vector<run>* row = get_row(f, y);
+	if (!row)
+		return 0;
+	auto ri = std::upper_bound(row->begin(), row->end(), x, [](uint32_t x, const run& r) { return x < r.end; });
+	if (ri != row->end() && ri->begin <= x)
+		return ri->label;
+	return 0;
+}
+
+bool label_volume::has_labels(uint32_t f) const
+{
+	return frames.find(f) != frames.end();
+}
+
+const std::vector<label_volume::run>* label_volume::get_row(uint32_t f, uint32_t y) const
+{
+	auto fi = frames.find(f);
+	if (fi == frames.end() || y >= height)
+		return 0;
+	return &fi->second.rows[y];
+}
+
+void label_volume::extract_frame(uint32_t f, label_type* labels) const
+{
+	std::fill_n(labels, size_t(width) * height, label_type(0));
+	auto fi = frames.find(f);
+	if (fi == frames.end())
+		return;
+	for (uint32_t y = 0; y < height; ++y)
+		for (const auto& r : fi->second.rows[y])
+			std::fill(labels + size_t(y) * width + r.begin, labels + size_t(y) * width + r.end, r.label);
+}
+
+void label_volume::extract_region(uint32_t f, const region& R, uint8_t* labels) const
+{
+	uint32_t region_width = R.x_end - R.x_begin;
+	std::fill_n(labels, size_t(region_width) * (R.y_end - R.y_begin), uint8_t(0));
+	auto fi = frames.find(f);
+	if (fi == frames.end())
+		return;
+	for (uint32_t y = R.y_begin; y < R.y_end; ++y) {
+		uint8_t* row = labels + size_t(y - R.y_begin) * region_width;
+		const auto& runs = fi->second.rows[y];
+		auto ri = std::lower_bound(runs.begin(), runs.end(), R.x_begin, [](const run& r, uint32_t x) { return r.end <= x; });
+		for (; ri != runs.end() && ri->begin < R.x_end; ++ri) {
+			uint32_t b = std::max(uint32_t(ri->begin), R.x_begin);
+			uint32_t e = std::min(uint32_t(ri->end), R.x_end);
+			std::fill(row + (b - R.x_begin), row + (e - R.x_begin), uint8_t(ri->label));
+		}
+	}
+}
+
+std::vector<uint32_t> label_volume::get_labeled_frames() const
+{
+	std::vector<uint32_t> result;
+	result.reserve(frames.size());
+	for (const auto& fi : frames)
+		result.push_back(fi.first);
+	return result;
+}
+
+void label_volume::compute_bounding_boxes() const
+{
+	label_boxes.assign(label_counts.size(), bounding_box{ { UINT32_MAX, UINT32_MAX, UINT32_MAX }, { 0, 0, 0 }, 0 });
+	for (const auto& fi : frames) {
+		for (uint32_t y = 0; y < height; ++y) {
+			for (const auto& r : fi.second.rows[y]) {
+				bounding_box& B = label_boxes[r.label];
+				B.min[0] = std::min(B.min[0], uint32_t(r.begin));
+				B.max[0] = std::max(B.max[0], uint32_t(r.end) - 1);
+				B.min[1] = std::min(B.min[1], y);
+				B.max[1] = std::max(B.max[1], y);
+				B.min[2] = std::min(B.min[2], fi.first);
+				B.max[2] = std::max(B.max[2], fi.first);
+				B.nr_voxels += r.end - r.begin;
+			}
+		}
+	}
+	boxes_outofdate = false;
+}
+
+uint64_t label_volume::get_nr_voxels(label_type label, uint32_t f) const
+{
+	if (label >= label_frame_counts.size())
+		return 0;
+	auto ai = label_frame_counts[label].find(f);
+	return ai == label_frame_counts[label].end() ? 0 : ai->second;
+}
+
+bool label_volume::get_frame_span(label_type label, uint32_t& frame_begin, uint32_t& frame_end) const
+{
+	if (label == 0 || label >= label_frame_counts.size() || label_frame_counts[label].empty())
+		return false;
+	frame_begin = label_frame_counts[label].begin()->first;
+	frame_end = label_frame_counts[label].rbegin()->first + 1;
+	return true;
+}
+
+const std::map<uint32_t, uint64_t>& label_volume::get_frame_areas(label_type label) const
+{
+	static const std::map<uint32_t, uint64_t> no_areas;
+	return label < label_frame_counts.size() ? label_frame_counts[label] : no_areas;
+}
+
+bool label_volume::get_bounding_box(label_type label, bounding_box& box) const
+{
+	if (label == 0 || get_nr_voxels(label) == 0)
+		return false;
+	if (boxes_outofdate || label_boxes.size() != label_counts.size())
+		compute_bounding_boxes();
+	box = label_boxes[label];
+	return true;
+}
+
+size_t label_volume::get_memory_usage() const
+{
+	size_t bytes = 0;
+	for (const auto& fi : frames) {
+		bytes += fi.second.rows.capacity() * sizeof(std::vector<run>);
+		for (const auto& row : fi.second.rows)
+			bytes += row.capacity() * sizeof(run);
+	}
+	return bytes;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdint>
+#include <cstddef>
+
+/// sparse per pixel and per frame class labels of a video, stored as run length encoded rows of the labeled frames;
+/// label 0 means unlabeled and frames are addressed by their absolute index in the video
+class label_volume
+{
+public:
+	typedef uint16_t label_type;
+	/// run of pixels [begin, end) in a row with the same label
+	struct run
+	{
+		uint16_t begin;
+		uint16_t end;
+		label_type label;
+	};
+	/// rectangle of pixels [x_begin, x_end) x [y_begin, y_end) within a frame
+	struct region
+	{
+		uint32_t x_begin, x_end;
+		uint32_t y_begin, y_end;
+	};
+	/// row of a frame whose runs are kept in the runs of a change record
+	struct row_change
+	{
+		uint32_t frame;
+		uint32_t y;
+		uint32_t run_begin;
+		uint32_t nr_runs;
+	};
+	/// content of all rows before they were changed while the record was set, restoring a record swaps its rows with the current ones
+	struct change_record
+	{
+		std::vector<row_change> rows;
+		std::vector<run> runs;
+		// per frame flags of rows that are already recorded, only needed while recording
+		std::map<uint32_t, std::vector<bool>> recorded_rows;
+		bool empty() const { return rows.empty(); }
+		/// release recording state that is not needed for restoring
+		void finish() { recorded_rows.clear(); rows.shrink_to_fit(); runs.shrink_to_fit(); }
+		size_t get_memory_usage() const { return rows.capacity() * sizeof(row_change) + runs.capacity() * sizeof(run); }
+	};
+	/// axis aligned box of voxels [min, max] over x, y and frame index
+	struct bounding_box
+	{
+		uint32_t min[3];
+		uint32_t max[3];
+		uint64_t nr_voxels;
+	};
+protected:
+	struct frame
+	{
+		// sorted runs of non zero labels per row
+		std::vector<std::vector<run>> rows;
+		uint64_t nr_voxels = 0;
+	};
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::map<uint32_t, frame> frames;
+	uint64_t nr_voxels = 0;
+	// number of voxels per label
+	std::vector<uint64_t> label_counts;
+	// per label the number of voxels in each frame that contains the label
+	std::vector<std::map<uint32_t, uint64_t>> label_frame_counts;
+	// incremented on every change of the label counts
+	uint64_t version = 0;
+	// bounding boxes per label, recomputed on query after changes
+	mutable std::vector<bounding_box> label_boxes;
+	mutable bool boxes_outofdate = false;
+	// per frame the bounding rectangle of pixels changed since last call to clear_modified_regions
+	std::map<uint32_t, region> modified_regions;
+	// frames changed since they were last saved or loaded
+	std::set<uint32_t> unsaved_frames;
+	// record that keeps rows before their first change
+	change_record* recording = 0;
+	void record_row(uint32_t f, uint32_t y);
+	void add_modified_region(uint32_t f, uint32_t x_begin, uint32_t x_end, uint32_t y_begin, uint32_t y_end);
+	void count_label(uint32_t f, label_type label, int64_t delta);
+	void compute_bounding_boxes() const;
+public:
+	label_volume();
+	/// set frame size and remove all labels without marking frames unsaved
+	void set_dimensions(uint32_t _width, uint32_t _height);
+	uint32_t get_width() const { return width; }
+	uint32_t get_height() const { return height; }
+	/// remove all labels
+	void clear();
+	/// set pixels [x_begin, x_end) of row y in frame f to label, which erases them for label 0
+	void paint_span(uint32_t f, uint32_t y, uint32_t x_begin, uint32_t x_end, label_type label);
+	/// set all pixels of frame f within the given radius around (x, y) to label
+	void paint_disk(uint32_t f, float x, float y, float radius, label_type label);
+	/// set all voxels within the ellipsoid around (x, y, f) with radii in pixels and frames to label
+	void paint_ellipsoid(float x, float y, float f, float radius_xy, float radius_f, label_type label);
+	/// remove all labels of frame f
+	void erase_frame(uint32_t f);
+	/// replace labels of frame f by dense image of width x height labels
+	void set_frame(uint32_t f, const label_type* labels);
+	/// return label of pixel (x, y) in frame f
+	label_type get_label(uint32_t f, uint32_t x, uint32_t y) const;
+	/// check whether frame f contains labels
+	bool has_labels(uint32_t f) const;
+	/// runs of row y in frame f, or 0 if the frame is not labeled
+	const std::vector<run>* get_row(uint32_t f, uint32_t y) const;
+	/// write labels of frame f as dense image of width x height labels
+	void extract_frame(uint32_t f, label_type* labels) const;
+	/// write labels of rectangle R of frame f row by row as 8 bit values, keeping the lower 8 bits of each label
+	void extract_region(uint32_t f, const region& R, uint8_t* labels) const;
+	/// labeled frames in ascending order
+	std::vector<uint32_t> get_labeled_frames() const;
+	uint64_t get_nr_voxels() const { return nr_voxels; }
+	uint64_t get_nr_voxels(label_type label) const { return label < label_counts.size() ? label_counts[label] : 0; }
+	/// number of voxels with label in frame f
+	uint64_t get_nr_voxels(label_type label, uint32_t f) const;
+	/// frames [frame_begin, frame_end) from first to last frame containing label, returns false if label is not used
+	bool get_frame_span(label_type label, uint32_t& frame_begin, uint32_t& frame_end) const;
+	/// area of label in each frame containing it
+	const std::map<uint32_t, uint64_t>& get_frame_areas(label_type label) const;
+	/// changes whenever voxel counts change, i.e. to refresh statistics only when needed
+	uint64_t get_version() const { return version; }
+	size_t get_nr_labeled_frames() const { return frames.size(); }
+	/// largest label with voxels or 0 if there are none
+	label_type get_max_label() const;
+	/// compute bounding box of label, returns false if label is not used
+	bool get_bounding_box(label_type label, bounding_box& box) const;
+	/// approximate memory used by runs in bytes
+	size_t get_memory_usage() const;
+	/// per frame the rectangle changed since the last call of clear_modified_regions, i.e. for uploading it
+	const std::map<uint32_t, region>& get_modified_regions() const { return modified_regions; }
+	void clear_modified_regions() { modified_regions.clear(); }
+	/// record original content of all rows changed from now on in record, or stop recording for 0
+	void set_change_record(change_record* record) { recording = record; }
+	/// swap rows of record with the current rows, such that restoring twice is a no-op
+	void restore(change_record& record);
+	/// frames changed since they were saved or loaded, which set_dimensions forgets
+	const std::set<uint32_t>& get_unsaved_frames() const { return unsaved_frames; }
+	bool is_unsaved(uint32_t f) const { return unsaved_frames.find(f) != unsaved_frames.end(); }
+	void mark_saved(uint32_t f) { unsaved_frames.erase(f); }
+};
@@ -0,0 +1,186 @@
+#include "pbo_uploader.h"
+#include <cgv_gl/gl/gl.h>
+#include <cgv_gl/gl/gl_tools.h>
+#include <cstring>
+
+pbo_uploader::pbo_uploader(unsigned nr_slots) : slots(nr_slots)
+{
+	worker = std::thread(&pbo_uploader::copy_jobs, this);
+}
+
+pbo_uploader::~pbo_uploader()
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		stop_worker = true;
+	}
+	job_cond.notify_all();
+	worker.join();
+}
+
+void pbo_uploader::copy_jobs()
+{
+	for (;;) {
+		job j;
+		{
+			std::unique_lock<std::mutex> lock(job_mutex);
+			job_cond.wait(lock, [this] { return stop_worker || !jobs.empty(); });
+			if (stop_worker)
+				return;
+			j = jobs.front();
+			jobs.pop_front();
+		}
+		std::memcpy(j.dst, j.src, j.size);
+		{
+			std::lock_guard<std::mutex> lock(job_mutex);
+			j.target->state = slot_state::filled;
+			--nr_pending_copies;
+		}
+		idle_cond.notify_all();
+	}
+}
+
+void pbo_uploader::process(cgv::render::context&)
+{
+	for (auto& s : slots) {
+		slot_state state;
+		{
+			std::lock_guard<std::mutex> lock(job_mutex);
+			state = s.state;
+		}
+		// retire copies finished on GPU
+		if (state == slot_state::in_flight) {
+			GLenum result = glClientWaitSync(GLsync(s.fence), 0, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+				continue;
+			glDeleteSync(GLsync(s.fence));
+			s.fence = 0;
+			bytes_in_flight -= s.size;
+			last_latency = std::chrono::duration<double, std::milli>(clock_type::now() - s.submit_time).count();
+			average_latency = average_latency == 0 ? last_latency : 0.9 * average_latency + 0.1 * last_latency;
+			std::lock_guard<std::mutex> lock(job_mutex);
+			s.state = slot_state::free;
+		}
+		// start texture copy of buffers filled by worker
+		else if (state == slot_state::filled) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			s.mapped_ptr = 0;
+			if (s.generation != generation) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				bytes_in_flight -= s.size;
+				std::lock_guard<std::mutex> lock(job_mutex);
+				s.state = slot_state::free;
+				continue;
+			}
+			glBindTexture(GL_TEXTURE_3D, s.tex_id);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage3D(GL_TEXTURE_3D, 0, s.x, s.y, s.z, s.width, s.height, s.depth, s.format, s.type, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindTexture(GL_TEXTURE_3D, 0);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			std::lock_guard<std::mutex> lock(job_mutex);
+			s.state = slot_state::in_flight;
+		}
+	}
+}
+
+bool pbo_uploader::has_free_slot() const
+{
+	std::lock_guard<std::mutex> lock(job_mutex);
+	for (const auto& s : slots)
+		if (s.state == slot_state::free)
+			return true;
+	return false;
+}
+
+bool pbo_uploader::submit(cgv::render::context&, const cgv::render::texture& tex, int x, int y, int z, int width, int height, int depth,
+	unsigned format, unsigned type, const void* src, size_t size)
+{
+	slot* sp = 0;
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		for (auto& s : slots)
+			if (s.state == slot_state::free) {
+				sp = &s;
+				break;
+			}
+	}
+	if (!sp || !tex.is_created())
+		return false;
+	slot& s = *sp;
+	if (s.pbo == 0)
+		glGenBuffers(1, &s.pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+	// grow buffer if necessary, otherwise orphan its previous content on map
+	if (s.capacity < size) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), 0, GL_STREAM_DRAW);
+		s.capacity = size;
+	}
+	s.mapped_ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!s.mapped_ptr)
+		return false;
+	s.tex_id = cgv::render::gl::get_gl_id(tex.handle);
+	s.format = format;
+	s.type = type;
+	s.x = x; s.y = y; s.z = z;
+	s.width = width; s.height = height; s.depth = depth;
+	s.size = size;
+	s.generation = generation;
+	s.submit_time = clock_type::now();
+	bytes_in_flight += size;
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		s.state = slot_state::filling;
+		jobs.push_back({ s.mapped_ptr, src, size, &s });
+		++nr_pending_copies;
+	}
+	job_cond.notify_one();
+	return true;
+}
+
+void pbo_uploader::wait_for_copies()
+{
+	std::unique_lock<std::mutex> lock(job_mutex);
+	idle_cond.wait(lock, [this] { return nr_pending_copies == 0; });
+}
+
+void pbo_uploader::invalidate()
+{
+	++generation;
+}
+
+bool pbo_uploader::is_idle() const
+{
+	std::lock_guard<std::mutex> lock(job_mutex);
+	for (const auto& s : slots)
+		if (s.state != slot_state::free)
+			return false;
+	return true;
+}
+
+void pbo_uploader::destruct(cgv::render::context&)
+{
+	wait_for_copies();
+	for (auto& s : slots) {
+		if (s.fence) {
+			glDeleteSync(GLsync(s.fence));
+			s.fence = 0;
+		}
+		if (s.pbo) {
+			if (s.mapped_ptr) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				s.mapped_ptr = 0;
+			}
+			glDeleteBuffers(1, &s.pbo);
+			s.pbo = 0;
+		}
+		s.capacity = 0;
+		s.state = slot_state::free;
+	}
+	bytes_in_flight = 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cgv/render/context.h>
+#include <cgv/render/texture.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+
+/// ring of pixel buffer objects that are filled by a worker thread and copied into sub boxes of 3d textures;
+/// a fence per copy tells when the GPU has finished so that callers can swap in the target texture
+class pbo_uploader
+{
+public:
+	typedef std::chrono::steady_clock clock_type;
+protected:
+	enum class slot_state { free, filling, filled, in_flight };
+	struct slot
+	{
+		unsigned pbo = 0;
+		size_t capacity = 0;
+		// guarded by job_mutex while a copy job is pending
+		slot_state state = slot_state::free;
+		void* mapped_ptr = 0;
+		// target of copy
+		unsigned tex_id = 0;
+		unsigned format = 0, type = 0;
+		int x = 0, y = 0, z = 0;
+		int width = 0, height = 0, depth = 0;
+		size_t size = 0;
+		uint64_t generation = 0;
+		// GLsync of texture copy
+		void* fence = 0;
+		clock_type::time_point submit_time;
+	};
+	struct job
+	{
+		void* dst;
+		const void* src;
+		size_t size;
+		slot* target;
+	};
+	std::vector<slot> slots;
+	uint64_t generation = 0;
+	// copy jobs for the worker thread
+	std::deque<job> jobs;
+	mutable std::mutex job_mutex;
+	std::condition_variable job_cond;
+	std::thread worker;
+	bool stop_worker = false;
+	size_t nr_pending_copies = 0;
+	std::condition_variable idle_cond;
+	void copy_jobs();
+	// statistics
+	size_t bytes_in_flight = 0;
+	double last_latency = 0;
+	double average_latency = 0;
+public:
+	pbo_uploader(unsigned nr_slots = 3);
+	~pbo_uploader();
+	/// retire finished copies and start texture copies of filled buffers, call once per frame in render thread
+	void process(cgv::render::context& ctx);
+	/// check whether a buffer is available for submit
+	bool has_free_slot() const;
+	/// map a buffer, let the worker copy size bytes from src into it and later copy the buffer into the given box of the 3d texture
+	bool submit(cgv::render::context& ctx, const cgv::render::texture& tex, int x, int y, int z, int width, int height, int depth,
+		unsigned format, unsigned type, const void* src, size_t size);
+	/// wait until the worker finished all copies from host memory, such that source data can be modified
+	void wait_for_copies();
+	/// drop results of all submitted but not yet copied uploads, i.e. because source or target changed
+	void invalidate();
+	/// check whether no upload is pending on host or GPU side
+	bool is_idle() const;
+	/// release buffers and fences, must be called in render thread with current context
+	void destruct(cgv::render::context& ctx);
+	size_t get_bytes_in_flight() const { return bytes_in_flight; }
+	/// latency in ms from submit to completion on the GPU of the last and averaged over recent uploads
+	double get_last_latency() const { return last_latency; }
+	double get_average_latency() const { return average_latency; }
+};
@@ -0,0 +1,46 @@
+#include "pose_filter.h"
+#include <cmath>
+
+namespace {
+	// weight of a new sample in an exponential low pass with the given cutoff frequency
+	float smoothing_factor(float dt, float cutoff)
+	{
+		float tau = 1.0f / (2.0f * float(M_PI) * cutoff);
+		return 1.0f / (1.0f + tau / dt);
+	}
+}
+
+void pose_filter::channel::update(const vec3& x, float dt, float min_cutoff, float beta, float derivative_cutoff)
+{
+	vec3 dx = (x - raw) / dt;
+	raw = x;
+	derivative += smoothing_factor(dt, derivative_cutoff) * (dx - derivative);
+	// cutoff rises with speed
+	float cutoff = min_cutoff + beta * derivative.length();
+	value += smoothing_factor(dt, cutoff) * (x - value);
+}
+
+void pose_filter::apply(double time, vec3& origin, vec3& direction)
+{
+	if (!enabled)
+		return;
+	float dt = float(time - last_time);
+	if (!initialized || dt > reset_time || dt < 0) {
+		origin_channel.value = origin_channel.raw = origin;
+		direction_channel.value = direction_channel.raw = direction;
+		origin_channel.derivative = direction_channel.derivative = vec3(0.0f);
+		last_time = time;
+		initialized = true;
+		return;
+	}
+	// updates at the same time keep the state
+	if (dt > 0) {
+		last_time = time;
+		origin_channel.update(origin, dt, min_cutoff, beta, derivative_cutoff);
+		direction_channel.update(direction, dt, min_cutoff, beta, derivative_cutoff);
+	}
+	// only the output direction is normalized, the filter state follows the raw directions
+	origin = origin_channel.value + prediction_time * origin_channel.derivative;
+	direction = direction_channel.value + prediction_time * direction_channel.derivative;
+	direction.normalize();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cgv/math/fvec.h>
+
+/// One Euro filter of the origin and direction of the slice held by the controller, which smoothes jitter at low
+/// speeds and follows quickly at high speeds, followed by a prediction along the filtered velocity to the expected
+/// display time. Each update takes constant time.
+class pose_filter
+{
+public:
+	typedef cgv::math::fvec<float, 3> vec3;
+	bool enabled = true;
+	/// cutoff frequency in Hz at rest, lower values smooth more
+	float min_cutoff = 1.0f;
+	/// increase of the cutoff frequency per unit speed, higher values reduce lag in fast motions
+	float beta = 50.0f;
+	/// cutoff frequency in Hz of the velocity estimate
+	float derivative_cutoff = 1.0f;
+	/// time in seconds from the pose update to the display of the frame
+	float prediction_time = 0.02f;
+	/// gap in seconds after which the filter restarts, e.g. after tracking was lost
+	float reset_time = 0.5f;
+
+	/// forget the filtered state such that the next update passes its pose through
+	void reset() { initialized = false; }
+	/// replace origin and direction by the filtered and predicted pose at time in seconds, keeping direction normalized
+	void apply(double time, vec3& origin, vec3& direction);
+protected:
+	struct channel
+	{
+		vec3 value, derivative;
+		// previous raw sample, which the velocity is estimated from
+		vec3 raw;
+		// filter x and its derivative with time step dt
+		void update(const vec3& x, float dt, float min_cutoff, float beta, float derivative_cutoff);
+	};
+	channel origin_channel, direction_channel;
+	double last_time = 0;
+	bool initialized = false;
+};
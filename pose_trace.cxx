@@ -0,0 +1,201 @@
+#include "pose_trace.h"
+#include <fstream>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	const char pose_trace_magic[4] = { 'V', 'L', 'P', 'T' };
+	const uint32_t pose_trace_version = 2;
+	// time followed by the hmd and both controller poses, version 1 stops here
+	const uint32_t pose_record_size_v1 = 8 + 3 * 12 * 4;
+	// followed by axes and button flags of both controllers
+	const uint32_t pose_record_size = pose_record_size_v1 + 2 * 8 * 4 + 2 * 4;
+	const uint32_t key_event_record_size = 8 + 1 + 1 + 2;
+}
+
+bool pose_trace::read(const std::string& file_name)
+{
+	std::ifstream file(file_name, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	char magic[4];
+	uint32_t version = 0;
+	file.read(magic, 4);
+	file.read(reinterpret_cast<char*>(&version), 4);
+	if (!file || std::memcmp(magic, pose_trace_magic, 4) != 0 || version > pose_trace_version)
+		return false;
+	clear();
+	// records are type and size followed by the payload, such that unknown records can be skipped
+	uint8_t type;
+	uint32_t size;
+	while (file.read(reinterpret_cast<char*>(&type), 1) && file.read(reinterpret_cast<char*>(&size), 4)) {
+		if (type == RT_KEY_EVENT && size == key_event_record_size) {
+			key_event e;
+			file.read(reinterpret_cast<char*>(&e.time), 8);
+			file.read(reinterpret_cast<char*>(&e.controller_index), 1);
+			file.read(reinterpret_cast<char*>(&e.action), 1);
+			file.read(reinterpret_cast<char*>(&e.key), 2);
+			if (!file)
+				return false;
+			events.push_back(e);
+			continue;
+		}
+		if (type != RT_POSES || (size != pose_record_size && size != pose_record_size_v1)) {
+			file.seekg(size, std::ios::cur);
+			continue;
+		}
+		pose_sample s = {};
+		file.read(reinterpret_cast<char*>(&s.time), 8);
+		file.read(reinterpret_cast<char*>(s.hmd), sizeof(s.hmd));
+		file.read(reinterpret_cast<char*>(s.controller), sizeof(s.controller));
+		if (size == pose_record_size) {
+			file.read(reinterpret_cast<char*>(s.axes), sizeof(s.axes));
+			file.read(reinterpret_cast<char*>(s.button_flags), sizeof(s.button_flags));
+		}
+		if (!file)
+			return false;
+		samples.push_back(s);
+	}
+	return true;
+}
+
+bool pose_trace::write(const std::string& file_name) const
+{
+	std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	file.write(pose_trace_magic, 4);
+	file.write(reinterpret_cast<const char*>(&pose_trace_version), 4);
+	// poses and events are interleaved in time order
+	uint8_t pose_type = RT_POSES, event_type = RT_KEY_EVENT;
+	size_t j = 0;
+	for (size_t i = 0; i <= samples.size(); ++i) {
+		for (; j < events.size() && (i == samples.size() || events[j].time <= samples[i].time); ++j) {
+			const key_event& e = events[j];
+			file.write(reinterpret_cast<const char*>(&event_type), 1);
+			file.write(reinterpret_cast<const char*>(&key_event_record_size), 4);
+			file.write(reinterpret_cast<const char*>(&e.time), 8);
+			file.write(reinterpret_cast<const char*>(&e.controller_index), 1);
+			file.write(reinterpret_cast<const char*>(&e.action), 1);
+			file.write(reinterpret_cast<const char*>(&e.key), 2);
+		}
+		if (i == samples.size())
+			break;
+		const pose_sample& s = samples[i];
+		file.write(reinterpret_cast<const char*>(&pose_type), 1);
+		file.write(reinterpret_cast<const char*>(&pose_record_size), 4);
+		file.write(reinterpret_cast<const char*>(&s.time), 8);
+		file.write(reinterpret_cast<const char*>(s.hmd), sizeof(s.hmd));
+		file.write(reinterpret_cast<const char*>(s.controller), sizeof(s.controller));
+		file.write(reinterpret_cast<const char*>(s.axes), sizeof(s.axes));
+		file.write(reinterpret_cast<const char*>(s.button_flags), sizeof(s.button_flags));
+	}
+	return bool(file);
+}
+
+void pose_trace::append_state(double time, const vr::vr_kit_state& state)
+{
+	pose_sample s;
+	s.time = time;
+	std::memcpy(s.hmd, state.hmd.pose, sizeof(s.hmd));
+	for (int ci = 0; ci < 2; ++ci) {
+		std::memcpy(s.controller[ci], state.controller[ci].pose, sizeof(s.controller[ci]));
+		std::memcpy(s.axes[ci], state.controller[ci].axes, sizeof(s.axes[ci]));
+		s.button_flags[ci] = state.controller[ci].button_flags;
+	}
+	samples.push_back(s);
+}
+
+void pose_trace::append_key_event(double time, int controller_index, unsigned short key, int action)
+{
+	events.push_back({ time, uint8_t(controller_index), uint8_t(action), uint16_t(key) });
+}
+
+void pose_trace::get_state(size_t i, vr::vr_kit_state& state) const
+{
+	const pose_sample& s = samples[i];
+	state.hmd.status = vr::VRS_TRACKED;
+	std::memcpy(state.hmd.pose, s.hmd, sizeof(s.hmd));
+	for (int ci = 0; ci < 2; ++ci) {
+		vr::vr_controller_state& cs = state.controller[ci];
+		cs.status = vr::VRS_TRACKED;
+		std::memcpy(cs.pose, s.controller[ci], sizeof(s.controller[ci]));
+		std::memcpy(cs.axes, s.axes[ci], sizeof(s.axes[ci]));
+		cs.button_flags = s.button_flags[ci];
+	}
+}
+
+double pose_trace::get_duration() const
+{
+	return samples.empty() ? 0.0 : samples.back().time - samples.front().time;
+}
+
+void pose_trace::create_sweep(size_t nr_samples, double rate, const vec3& center, const vec3& half_extent)
+{
+	static const float identity[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+	clear();
+	samples.resize(nr_samples);
+	for (size_t i = 0; i < nr_samples; ++i) {
+		pose_sample& s = samples[i];
+		s = {};
+		s.time = i / rate;
+		float phase = float(2 * M_PI * s.time / 4.0);
+		std::memcpy(s.hmd, identity, sizeof(identity));
+		std::memcpy(s.controller[0], identity, sizeof(identity));
+		std::memcpy(s.controller[1], identity, sizeof(identity));
+		// head looks at the volume from above the front
+		s.hmd[10] = center[1] + 0.5f;
+		s.hmd[11] = center[2] + 0.6f;
+		// right controller moves along x through the volume and rolls around z, its y axis is the slice normal
+		float angle = 0.6f * std::sin(3 * phase);
+		float* c = s.controller[1];
+		c[0] = std::cos(angle); c[1] = std::sin(angle); c[2] = 0;
+		c[3] = -std::sin(angle); c[4] = std::cos(angle); c[5] = 0;
+		c[6] = 0; c[7] = 0; c[8] = 1;
+		c[9] = center[0] + half_extent[0] * std::sin(phase);
+		c[10] = center[1] + half_extent[1];
+		c[11] = center[2] + 0.5f * half_extent[2] * std::cos(2 * phase);
+		// left controller points at the volume
+		s.controller[0][9] = center[0] - half_extent[0];
+		s.controller[0][10] = center[1];
+		s.controller[0][11] = center[2] + half_extent[2];
+	}
+}
+
+void pose_replayer::start(const pose_trace& _trace, bool _real_time)
+{
+	trace = &_trace;
+	real_time = _real_time;
+	next_sample = 0;
+	next_event = 0;
+	time = _trace.samples.empty() ? 0.0 : _trace.samples.front().time;
+	start_time = std::chrono::steady_clock::now();
+}
+
+bool pose_replayer::advance(vr::vr_kit_state& state, std::vector<pose_trace::key_event>& due_events)
+{
+	if (!trace)
+		return false;
+	if (next_sample >= trace->samples.size()) {
+		stop();
+		return false;
+	}
+	size_t i = next_sample;
+	if (real_time) {
+		double t = trace->samples.front().time + std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+		while (i + 1 < trace->samples.size() && trace->samples[i + 1].time <= t)
+			++i;
+	}
+	trace->get_state(i, state);
+	// events recorded between two frames took effect on the later one
+	double sample_time = trace->samples[i].time;
+	time = sample_time;
+	while (next_event < trace->events.size() && trace->events[next_event].time <= sample_time)
+		due_events.push_back(trace->events[next_event++]);
+	next_sample = i + 1;
+	// deliver events after the last sample with it
+	if (next_sample == trace->samples.size())
+		while (next_event < trace->events.size())
+			due_events.push_back(trace->events[next_event++]);
+	return true;
+}
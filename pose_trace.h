@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cgv/math/fvec.h>
+#include <vr/vr_state.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+/// timestamped poses of the head mounted display and both controllers together with controller input and key events,
+/// stored in a compact binary file of records following a header with magic "VLPT" and the format version
+class pose_trace
+{
+public:
+	typedef cgv::math::fvec<float, 3> vec3;
+	/// column major 3x4 poses as in vr::vr_kit_state, where columns 0 to 2 are the axes and column 3 the position
+	struct pose_sample
+	{
+		double time;
+		float hmd[12];
+		float controller[2][12];
+		// controller axes with the trigger at index 2 and pressed buttons
+		float axes[2][8];
+		uint32_t button_flags[2];
+	};
+	/// key of a controller pressed or released at time
+	struct key_event
+	{
+		double time;
+		uint8_t controller_index;
+		uint8_t action;
+		uint16_t key;
+	};
+	enum record_type : uint8_t
+	{
+		RT_POSES = 1,
+		RT_KEY_EVENT = 2
+	};
+	std::vector<pose_sample> samples;
+	/// key events ordered by time
+	std::vector<key_event> events;
+
+	bool read(const std::string& file_name);
+	bool write(const std::string& file_name) const;
+	void clear() { samples.clear(); events.clear(); }
+	/// append poses, axes and buttons of the hmd and the first two controllers at time
+	void append_state(double time, const vr::vr_kit_state& state);
+	void append_key_event(double time, int controller_index, unsigned short key, int action);
+	/// copy sample i to state and mark the hmd and both controllers as tracked
+	void get_state(size_t i, vr::vr_kit_state& state) const;
+	/// duration from first to last sample in seconds
+	double get_duration() const;
+	/// replace samples by a sweep of the right controller, which holds the slice, through a volume at center with
+	/// given half extent while tilting it back and forth, sampled at rate samples per second
+	void create_sweep(size_t nr_samples, double rate, const vec3& center, const vec3& half_extent);
+};
+
+/// replays a pose trace deterministically, either one sample per call or at the speed of the recording
+class pose_replayer
+{
+	const pose_trace* trace = nullptr;
+	size_t next_sample = 0;
+	size_t next_event = 0;
+	double time = 0;
+	bool real_time = false;
+	std::chrono::steady_clock::time_point start_time;
+public:
+	/// the trace must stay alive until the replay is stopped or finished
+	void start(const pose_trace& _trace, bool _real_time);
+	void stop() { trace = nullptr; }
+	bool is_running() const { return trace != nullptr; }
+	/// number of the next sample to be replayed
+	size_t get_position() const { return next_sample; }
+	/// recording time of the sample written by the last advance
+	double get_time() const { return time; }
+	/// write the next sample to state and append the key events up to its time to due_events. In real time mode the
+	/// next sample is the last one not after the elapsed time. Returns false and stops once all samples were replayed.
+	bool advance(vr::vr_kit_state& state, std::vector<pose_trace::key_event>& due_events);
+};
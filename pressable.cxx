@@ -1,4 +1,5 @@
 #include "pressable.h"
+#include "frame_timing.h"
 #include <cgv/math/proximity.h>
 #include <cgv/math/intersection.h>
 
@@ -128,6 +129,7 @@ void pressable::clear(cgv::render::context& ctx)
 }
 void pressable::draw(cgv::render::context& ctx)
 {
+	VL_TIME_GPU_SCOPE(frame_timing::FS_PRESSABLE_DRAW);
 	// show box
 	auto& br = cgv::render::ref_box_renderer(ctx);
 	br.set_render_style(brs);
@@ -0,0 +1,212 @@
+#include "region_grower.h"
+#include <algorithm>
+
+region_grower::region_grower(unsigned nr_workers)
+{
+	for (unsigned i = 0; i < nr_workers; ++i)
+		workers.push_back(std::thread(&region_grower::grow_frames, this));
+}
+
+region_grower::~region_grower()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop_workers = true;
+	}
+	cond.notify_all();
+	for (auto& w : workers)
+		w.join();
+}
+
+bool region_grower::find_frame(uint32_t& f) const
+{
+	for (const auto& s : seeds)
+		if (busy_frames.find(s.first) == busy_frames.end()) {
+			f = s.first;
+			return true;
+		}
+	return false;
+}
+
+void region_grower::grow_frames()
+{
+	for (;;) {
+		uint32_t f;
+		std::vector<span> frame_seeds;
+		std::vector<uint64_t>* mask;
+		cached_colors* cached;
+		color_function c;
+		uint64_t g;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this, &f] { return stop_workers || find_frame(f); });
+			if (stop_workers)
+				return;
+			busy_frames.insert(f);
+			frame_seeds.swap(seeds[f]);
+			seeds.erase(f);
+			mask = &masks[f];
+			if (mask->empty())
+				mask->resize((size_t(width) * height + 63) / 64, 0);
+			cached = &color_cache[f];
+			cached->last_use = ++color_cache_use;
+			c = get_colors;
+			g = generation;
+			++nr_busy_workers;
+		}
+		std::vector<span> spans;
+		bool loaded = false;
+		if (cached->colors.empty())
+			loaded = c(f, cached->colors);
+		if (!cached->colors.empty())
+			fill_frame(f, frame_seeds, cached->colors, *mask, spans);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy_frames.erase(f);
+			--nr_busy_workers;
+			if (loaded) {
+				color_cache_size += cached->colors.size();
+				enforce_color_cache_budget();
+			}
+			if (g == generation && !spans.empty() && nr_voxels < max_voxels) {
+				for (const auto& s : spans)
+					nr_voxels += s.x_end - s.x_begin;
+				filled_spans.insert(filled_spans.end(), spans.begin(), spans.end());
+				if (f > frame_begin) {
+					auto& s = seeds[f - 1];
+					s.insert(s.end(), spans.begin(), spans.end());
+				}
+				if (f + 1 < frame_end) {
+					auto& s = seeds[f + 1];
+					s.insert(s.end(), spans.begin(), spans.end());
+				}
+			}
+		}
+		cond.notify_all();
+	}
+}
+
+void region_grower::enforce_color_cache_budget()
+{
+	while (color_cache_size > color_cache_budget) {
+		auto oldest = color_cache.end();
+		for (auto i = color_cache.begin(); i != color_cache.end(); ++i)
+			if (!i->second.colors.empty() && busy_frames.find(i->first) == busy_frames.end() &&
+				(oldest == color_cache.end() || i->second.last_use < oldest->second.last_use))
+				oldest = i;
+		if (oldest == color_cache.end())
+			return;
+		color_cache_size -= oldest->second.colors.size();
+		color_cache.erase(oldest);
+	}
+}
+
+void region_grower::fill_frame(uint32_t f, const std::vector<span>& frame_seeds, const std::vector<uint8_t>& colors, std::vector<uint64_t>& mask, std::vector<span>& spans) const
+{
+	auto is_visited = [&](size_t i) { return (mask[i >> 6] >> (i & 63)) & 1; };
+	auto accept = [&](size_t i) {
+		if (is_visited(i))
+			return false;
+		const uint8_t* c = &colors[3 * i];
+		int d0 = int(c[0]) - seed_color[0], d1 = int(c[1]) - seed_color[1], d2 = int(c[2]) - seed_color[2];
+		return uint32_t(d0 * d0 + d1 * d1 + d2 * d2) <= squared_threshold;
+	};
+	std::vector<uint32_t> stack;
+	// push first pixel of each run of acceptable pixels in [x_begin, x_end) of row y
+	auto push_runs = [&](uint32_t y, uint32_t x_begin, uint32_t x_end) {
+		size_t row = size_t(y) * width;
+		bool in_run = false;
+		for (uint32_t x = x_begin; x < x_end; ++x) {
+			bool a = accept(row + x);
+			if (a && !in_run)
+				stack.push_back(uint32_t(row + x));
+			in_run = a;
+		}
+	};
+	for (const auto& s : frame_seeds)
+		push_runs(s.y, s.x_begin, s.x_end);
+	while (!stack.empty()) {
+		size_t i = stack.back();
+		stack.pop_back();
+		if (!accept(i))
+			continue;
+		uint32_t y = uint32_t(i / width);
+		size_t row = size_t(y) * width;
+		uint32_t x_begin = uint32_t(i - row), x_end = x_begin + 1;
+		while (x_begin > 0 && accept(row + x_begin - 1))
+			--x_begin;
+		while (x_end < width && accept(row + x_end))
+			++x_end;
+		for (size_t j = row + x_begin; j < row + x_end; ++j)
+			mask[j >> 6] |= uint64_t(1) << (j & 63);
+		spans.push_back({ f, y, x_begin, x_end });
+		if (y > 0)
+			push_runs(y - 1, x_begin, x_end);
+		if (y + 1 < height)
+			push_runs(y + 1, x_begin, x_end);
+	}
+}
+
+bool region_grower::start(color_function _get_colors, uint32_t _width, uint32_t _height, uint32_t _frame_begin, uint32_t _frame_end,
+	uint32_t x, uint32_t y, uint32_t f, float threshold)
+{
+	cancel();
+	if (x >= _width || y >= _height || f < _frame_begin || f >= _frame_end)
+		return false;
+	std::vector<uint8_t> colors;
+	if (!_get_colors(f, colors))
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		get_colors = _get_colors;
+		width = _width;
+		height = _height;
+		frame_begin = _frame_begin;
+		frame_end = _frame_end;
+		std::copy_n(&colors[3 * (size_t(y) * width + x)], 3, seed_color);
+		squared_threshold = uint32_t(threshold * threshold);
+		seeds[f].push_back({ f, y, x, x + 1 });
+		// the seed frame is filled first, so keep its colors
+		auto& cached = color_cache[f];
+		cached.colors.swap(colors);
+		cached.last_use = ++color_cache_use;
+		color_cache_size += cached.colors.size();
+		enforce_color_cache_budget();
+	}
+	cond.notify_all();
+	return true;
+}
+
+void region_grower::cancel()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	++generation;
+	seeds.clear();
+	filled_spans.clear();
+	cond.wait(lock, [this] { return nr_busy_workers == 0; });
+	masks.clear();
+	color_cache.clear();
+	color_cache_size = 0;
+	nr_voxels = 0;
+}
+
+size_t region_grower::take_spans(std::vector<span>& spans, size_t max_spans)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t n = std::min(max_spans, filled_spans.size());
+	spans.assign(filled_spans.begin(), filled_spans.begin() + n);
+	filled_spans.erase(filled_spans.begin(), filled_spans.begin() + n);
+	return n;
+}
+
+bool region_grower::is_running() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !seeds.empty() || nr_busy_workers > 0;
+}
+
+uint64_t region_grower::get_nr_voxels() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return nr_voxels;
+}
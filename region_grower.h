@@ -0,0 +1,89 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+
+/// pool of worker threads that grow a 6-connected region of voxels with colors similar to the color of a seed voxel
+/// through the x/y/time volume; frames form a wavefront where each worker flood fills one frame at a time by scanlines
+/// and hands the newly filled spans as seeds to the neighbouring frames
+class region_grower
+{
+public:
+	/// write width x height colors with 3 components of absolute frame into colors, return false if the frame is not available
+	typedef std::function<bool(uint32_t frame, std::vector<uint8_t>& colors)> color_function;
+	/// pixels [x_begin, x_end) of row y in frame
+	struct span
+	{
+		uint32_t frame;
+		uint32_t y;
+		uint32_t x_begin, x_end;
+	};
+protected:
+	color_function get_colors;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// frames [frame_begin, frame_end) the region may grow into
+	uint32_t frame_begin = 0;
+	uint32_t frame_end = 0;
+	uint8_t seed_color[3] = { 0, 0, 0 };
+	uint32_t squared_threshold = 0;
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable cond;
+	bool stop_workers = false;
+	size_t nr_busy_workers = 0;
+	// increased by cancel such that workers drop results of the previous region
+	uint64_t generation = 0;
+	// visited pixels per frame as bit masks, each frame is only accessed by the worker filling it
+	std::map<uint32_t, std::vector<uint64_t>> masks;
+	// colors of frames that were filled before, as frames are revisited whenever a neighbour adds seeds; entries of
+	// busy frames are only accessed by the worker filling them and the least recently used others are evicted
+	struct cached_colors
+	{
+		std::vector<uint8_t> colors;
+		uint64_t last_use = 0;
+	};
+	std::map<uint32_t, cached_colors> color_cache;
+	size_t color_cache_size = 0;
+	uint64_t color_cache_use = 0;
+	// evict colors of least recently used frames that are not busy until the cache fits its budget, expects mutex to be locked
+	void enforce_color_cache_budget();
+	// spans of neighbouring frames from which the region grows into each frame
+	std::map<uint32_t, std::vector<span>> seeds;
+	std::set<uint32_t> busy_frames;
+	// filled spans not taken yet
+	std::deque<span> filled_spans;
+	uint64_t nr_voxels = 0;
+	void grow_frames();
+	// scanline fill frame from the seeds and append the filled spans
+	void fill_frame(uint32_t f, const std::vector<span>& frame_seeds, const std::vector<uint8_t>& colors, std::vector<uint64_t>& mask, std::vector<span>& spans) const;
+	// find frame with seeds that no worker is filling, expects mutex to be locked
+	bool find_frame(uint32_t& f) const;
+public:
+	/// stop growing once the region has this many voxels
+	uint64_t max_voxels = uint64_t(1) << 28;
+	/// maximum memory of cached frame colors in bytes
+	size_t color_cache_budget = size_t(256) << 20;
+
+	region_grower(unsigned nr_workers = 4);
+	~region_grower();
+	/// cancel current region and grow a new one from pixel (x, y) of frame f into frames [_frame_begin, _frame_end),
+	/// accepting voxels whose color differs from the seed color by at most threshold
+	bool start(color_function _get_colors, uint32_t _width, uint32_t _height, uint32_t _frame_begin, uint32_t _frame_end,
+		uint32_t x, uint32_t y, uint32_t f, float threshold);
+	/// stop growing, drop spans and cached colors and wait until workers no longer access frames
+	void cancel();
+	/// move at most max_spans filled spans to spans and return their number
+	size_t take_spans(std::vector<span>& spans, size_t max_spans);
+	/// check whether the region is still growing
+	bool is_running() const;
+	/// number of voxels filled so far
+	uint64_t get_nr_voxels() const;
+};
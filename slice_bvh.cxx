@@ -0,0 +1,326 @@
+#include "slice_bvh.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace {
+	typedef slice_bvh::vec3 vec3;
+
+	float surface_area(const vec3& box_min, const vec3& box_max)
+	{
+		vec3 e = box_max - box_min;
+		return 2.0f * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+	}
+	float union_area(const vec3& min0, const vec3& max0, const vec3& min1, const vec3& max1)
+	{
+		vec3 box_min, box_max;
+		for (int i = 0; i < 3; ++i) {
+			box_min[i] = std::min(min0[i], min1[i]);
+			box_max[i] = std::max(max0[i], max1[i]);
+		}
+		return surface_area(box_min, box_max);
+	}
+	// ray parameter interval of box, the inverse direction may contain infinities for axis parallel rays
+	bool intersect_box(const vec3& box_min, const vec3& box_max, const vec3& ray_start, const vec3& inverse_direction, float max_param)
+	{
+		float t_min = 0, t_max = max_param;
+		for (int i = 0; i < 3; ++i) {
+			float t0 = (box_min[i] - ray_start[i]) * inverse_direction[i];
+			float t1 = (box_max[i] - ray_start[i]) * inverse_direction[i];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			// comparisons are false for nan, which keeps the interval for rays starting on a box face
+			if (t0 > t_min)
+				t_min = t0;
+			if (t1 < t_max)
+				t_max = t1;
+			if (t_min > t_max)
+				return false;
+		}
+		return true;
+	}
+}
+
+int slice_bvh::allocate_node()
+{
+	if (free_nodes == -1) {
+		nodes.push_back(node());
+		return int(nodes.size() - 1);
+	}
+	int n = free_nodes;
+	free_nodes = nodes[n].parent;
+	nodes[n] = node();
+	return n;
+}
+
+void slice_bvh::free_node(int n)
+{
+	nodes[n].height = -1;
+	nodes[n].parent = free_nodes;
+	free_nodes = n;
+}
+
+void slice_bvh::refit(int n)
+{
+	node& N = nodes[n];
+	const node& A = nodes[N.child[0]];
+	const node& B = nodes[N.child[1]];
+	for (int i = 0; i < 3; ++i) {
+		N.box_min[i] = std::min(A.box_min[i], B.box_min[i]);
+		N.box_max[i] = std::max(A.box_max[i], B.box_max[i]);
+	}
+	N.height = 1 + std::max(A.height, B.height);
+}
+
+void slice_bvh::refit_ancestors(int n)
+{
+	for (; n != -1; n = nodes[n].parent)
+		refit(n);
+}
+
+void slice_bvh::insert_leaf(int leaf)
+{
+	if (root == -1) {
+		root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+	// descend to the sibling with the smallest increase of surface area
+	vec3 leaf_min = nodes[leaf].box_min, leaf_max = nodes[leaf].box_max;
+	int sibling = root;
+	while (!nodes[sibling].is_leaf()) {
+		const node& N = nodes[sibling];
+		float combined = union_area(N.box_min, N.box_max, leaf_min, leaf_max);
+		// cost of a new parent of this node and the leaf, and the cost increase passed on to the children
+		float cost = 2.0f * combined;
+		float inherited = 2.0f * (combined - surface_area(N.box_min, N.box_max));
+		float child_costs[2];
+		for (int c = 0; c < 2; ++c) {
+			const node& C = nodes[N.child[c]];
+			float area = union_area(C.box_min, C.box_max, leaf_min, leaf_max);
+			child_costs[c] = (C.is_leaf() ? area : area - surface_area(C.box_min, C.box_max)) + inherited;
+		}
+		if (cost < child_costs[0] && cost < child_costs[1])
+			break;
+		sibling = N.child[child_costs[1] < child_costs[0] ? 1 : 0];
+	}
+	int old_parent = nodes[sibling].parent;
+	int parent = allocate_node();
+	nodes[parent].parent = old_parent;
+	nodes[parent].child[0] = sibling;
+	nodes[parent].child[1] = leaf;
+	nodes[sibling].parent = parent;
+	nodes[leaf].parent = parent;
+	if (old_parent == -1)
+		root = parent;
+	else
+		nodes[old_parent].child[nodes[old_parent].child[0] == sibling ? 0 : 1] = parent;
+	refit_ancestors(parent);
+}
+
+void slice_bvh::remove_leaf(int leaf)
+{
+	if (leaf == root) {
+		root = -1;
+		return;
+	}
+	// replace parent by sibling
+	int parent = nodes[leaf].parent;
+	int grand_parent = nodes[parent].parent;
+	int sibling = nodes[parent].child[nodes[parent].child[0] == leaf ? 1 : 0];
+	nodes[sibling].parent = grand_parent;
+	if (grand_parent == -1)
+		root = sibling;
+	else {
+		nodes[grand_parent].child[nodes[grand_parent].child[0] == parent ? 0 : 1] = sibling;
+		refit_ancestors(grand_parent);
+	}
+	free_node(parent);
+}
+
+int slice_bvh::build_subtree(std::vector<int>& leaves, size_t begin, size_t end, int parent)
+{
+	if (end - begin == 1) {
+		nodes[leaves[begin]].parent = parent;
+		return leaves[begin];
+	}
+	// split at the median of the box centers along the axis of largest center extent
+	vec3 center_min(std::numeric_limits<float>::max()), center_max(-std::numeric_limits<float>::max());
+	for (size_t i = begin; i < end; ++i) {
+		vec3 c = nodes[leaves[i]].box_min + nodes[leaves[i]].box_max;
+		for (int j = 0; j < 3; ++j) {
+			center_min[j] = std::min(center_min[j], c[j]);
+			center_max[j] = std::max(center_max[j], c[j]);
+		}
+	}
+	vec3 extent = center_max - center_min;
+	int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+	size_t middle = (begin + end) / 2;
+	std::nth_element(leaves.begin() + begin, leaves.begin() + middle, leaves.begin() + end, [this, axis](int a, int b) {
+		return nodes[a].box_min[axis] + nodes[a].box_max[axis] < nodes[b].box_min[axis] + nodes[b].box_max[axis];
+	});
+	int n = allocate_node();
+	nodes[n].parent = parent;
+	int left = build_subtree(leaves, begin, middle, n);
+	int right = build_subtree(leaves, middle, end, n);
+	nodes[n].child[0] = left;
+	nodes[n].child[1] = right;
+	refit(n);
+	return n;
+}
+
+float slice_bvh::intersect_item(size_t item, const vec3& ray_start, const vec3& ray_direction) const
+{
+	const slice_polygon& P = polygons[item];
+	const vec3& n = normals[item];
+	float denominator = dot(n, ray_direction);
+	if (std::abs(denominator) < 1e-12f)
+		return -1;
+	float t = dot(n, P.vertices[0] - ray_start) / denominator;
+	if (t < 0)
+		return -1;
+	// hit point must lie on the same side of all edges of the convex polygon
+	vec3 p = ray_start + t * ray_direction;
+	bool has_positive = false, has_negative = false;
+	for (uint32_t i = 0; i < P.nr_vertices; ++i) {
+		const vec3& a = P.vertices[i];
+		const vec3& b = P.vertices[(i + 1) % P.nr_vertices];
+		float side = dot(cross(b - a, p - a), n);
+		has_positive = has_positive || side > 0;
+		has_negative = has_negative || side < 0;
+	}
+	return has_positive && has_negative ? -1 : t;
+}
+
+void slice_bvh::clear()
+{
+	nodes.clear();
+	root = -1;
+	free_nodes = -1;
+	item_leaves.clear();
+	polygons.clear();
+	normals.clear();
+}
+
+void slice_bvh::rebuild()
+{
+	std::vector<node> leaf_nodes;
+	for (int leaf : item_leaves)
+		if (leaf != -1)
+			leaf_nodes.push_back(nodes[leaf]);
+	nodes.clear();
+	root = -1;
+	free_nodes = -1;
+	std::vector<int> leaves;
+	for (node& L : leaf_nodes) {
+		int leaf = allocate_node();
+		nodes[leaf] = L;
+		item_leaves[L.item] = leaf;
+		leaves.push_back(leaf);
+	}
+	if (!leaves.empty())
+		root = build_subtree(leaves, 0, leaves.size(), -1);
+}
+
+void slice_bvh::insert_polygon_leaf(size_t index)
+{
+	// slices missing the volume cannot be hit
+	const slice_polygon& polygon = polygons[index];
+	if (polygon.nr_vertices < 3)
+		return;
+	int leaf = allocate_node();
+	node& L = nodes[leaf];
+	L.item = index;
+	L.height = 0;
+	L.box_min = L.box_max = polygon.vertices[0];
+	for (uint32_t i = 1; i < polygon.nr_vertices; ++i)
+		for (int j = 0; j < 3; ++j) {
+			L.box_min[j] = std::min(L.box_min[j], polygon.vertices[i][j]);
+			L.box_max[j] = std::max(L.box_max[j], polygon.vertices[i][j]);
+		}
+	item_leaves[index] = leaf;
+	insert_leaf(leaf);
+	// insertion order can unbalance the tree, e.g. for slices created in a sweep
+	size_t nr_leaves = 0;
+	for (int l : item_leaves)
+		nr_leaves += l != -1 ? 1 : 0;
+	if (nodes[root].height > 2 * int(std::log2(double(nr_leaves))) + 4)
+		rebuild();
+}
+
+void slice_bvh::insert_item(size_t index, const slice_polygon& polygon, const vec3& normal)
+{
+	index = std::min(index, item_leaves.size());
+	item_leaves.insert(item_leaves.begin() + index, -1);
+	polygons.insert(polygons.begin() + index, polygon);
+	normals.insert(normals.begin() + index, normal);
+	for (size_t i = index + 1; i < item_leaves.size(); ++i)
+		if (item_leaves[i] != -1)
+			nodes[item_leaves[i]].item = i;
+	insert_polygon_leaf(index);
+}
+
+void slice_bvh::update_item(size_t index, const slice_polygon& polygon, const vec3& normal)
+{
+	if (index >= item_leaves.size())
+		return;
+	polygons[index] = polygon;
+	normals[index] = normal;
+	// reinsert the leaf, which keeps the indices of all other slices
+	if (item_leaves[index] != -1) {
+		remove_leaf(item_leaves[index]);
+		free_node(item_leaves[index]);
+		item_leaves[index] = -1;
+	}
+	insert_polygon_leaf(index);
+}
+
+void slice_bvh::remove_items(size_t index, size_t count)
+{
+	if (index >= item_leaves.size())
+		return;
+	count = std::min(count, item_leaves.size() - index);
+	for (size_t i = index; i < index + count; ++i)
+		if (item_leaves[i] != -1) {
+			remove_leaf(item_leaves[i]);
+			free_node(item_leaves[i]);
+		}
+	item_leaves.erase(item_leaves.begin() + index, item_leaves.begin() + index + count);
+	polygons.erase(polygons.begin() + index, polygons.begin() + index + count);
+	normals.erase(normals.begin() + index, normals.begin() + index + count);
+	for (size_t i = index; i < item_leaves.size(); ++i)
+		if (item_leaves[i] != -1)
+			nodes[item_leaves[i]].item = i;
+}
+
+bool slice_bvh::intersect(const vec3& ray_start, const vec3& ray_direction, float max_param, float& hit_param, size_t& index, size_t ignored_index) const
+{
+	if (root == -1)
+		return false;
+	vec3 inverse_direction(1.0f / ray_direction[0], 1.0f / ray_direction[1], 1.0f / ray_direction[2]);
+	bool found = false;
+	// the height is kept logarithmic by rebuilding, so the stack cannot overflow
+	int stack[128];
+	int nr_stacked = 0;
+	stack[nr_stacked++] = root;
+	while (nr_stacked > 0) {
+		const node& N = nodes[stack[--nr_stacked]];
+		if (!intersect_box(N.box_min, N.box_max, ray_start, inverse_direction, max_param))
+			continue;
+		if (N.is_leaf()) {
+			if (N.item == ignored_index)
+				continue;
+			float t = intersect_item(N.item, ray_start, ray_direction);
+			if (t >= 0 && t < max_param) {
+				max_param = t;
+				hit_param = t;
+				index = N.item;
+				found = true;
+			}
+			continue;
+		}
+		stack[nr_stacked++] = N.child[0];
+		stack[nr_stacked++] = N.child[1];
+	}
+	return found;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "slice_clipper.h"
+#include <cgv/math/fvec.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/// bounding volume hierarchy over the clipped polygons of the oblique slices for picking slices with rays; items are
+/// addressed by slice index and leaves are inserted and removed incrementally, such that creating or deleting a slice
+/// does not rebuild the tree
+class slice_bvh
+{
+public:
+	typedef cgv::math::fvec<float, 3> vec3;
+protected:
+	struct node
+	{
+		vec3 box_min, box_max;
+		int parent = -1;
+		// children of inner nodes, leaves have child[0] == -1
+		int child[2] = { -1, -1 };
+		// slice index of leaf
+		size_t item = 0;
+		// height of subtree, 0 for leaves and -1 for unused nodes
+		int height = -1;
+		bool is_leaf() const { return child[0] == -1; }
+	};
+	std::vector<node> nodes;
+	int root = -1;
+	// unused nodes linked through parent
+	int free_nodes = -1;
+	// per item its leaf or -1 for slices missing the volume
+	std::vector<int> item_leaves;
+	std::vector<slice_polygon> polygons;
+	std::vector<vec3> normals;
+	int allocate_node();
+	void free_node(int n);
+	// combine boxes of children of n
+	void refit(int n);
+	// refit ancestors of n up to the root
+	void refit_ancestors(int n);
+	void insert_leaf(int leaf);
+	void remove_leaf(int leaf);
+	// create leaf of polygon of item index, if it hits the volume, and insert it into the tree
+	void insert_polygon_leaf(size_t index);
+	int build_subtree(std::vector<int>& leaves, size_t begin, size_t end, int parent);
+	// ray parameter of intersection with plane of item within its polygon or -1
+	float intersect_item(size_t item, const vec3& ray_start, const vec3& ray_direction) const;
+public:
+	/// remove all items
+	void clear();
+	/// rebuild the tree of all items top down, which gives a better tree than a sequence of insertions
+	void rebuild();
+	/// insert polygon of slice at index, which shifts the following slice indices by one
+	void insert_item(size_t index, const slice_polygon& polygon, const vec3& normal);
+	/// replace polygon of slice at index without changing the indices of other slices
+	void update_item(size_t index, const slice_polygon& polygon, const vec3& normal);
+	/// remove count slices starting at index
+	void remove_items(size_t index, size_t count = 1);
+	size_t get_nr_items() const { return item_leaves.size(); }
+	/// height of the tree, 0 for a single leaf and -1 if empty
+	int get_height() const { return root == -1 ? -1 : nodes[root].height; }
+	/// find closest slice hit by ray with parameter in [0, max_param) other than ignored_index, where the parameter is measured in
+	/// units of the ray direction
+	bool intersect(const vec3& ray_start, const vec3& ray_direction, float max_param, float& hit_param, size_t& index, size_t ignored_index = size_t(-1)) const;
+};
@@ -0,0 +1,174 @@
+#include "slice_clipper.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SLICE_CLIPPER_SSE
+#endif
+
+namespace {
+	// corner c of the box has the maximum coordinate along axis i if bit i of c is set;
+	// edges 0-3 run along x, 4-7 along y and 8-11 along z
+	const int edge_corners[12][2] = {
+		{ 0, 1 }, { 2, 3 }, { 6, 7 }, { 4, 5 },
+		{ 0, 2 }, { 4, 6 }, { 5, 7 }, { 1, 3 },
+		{ 0, 4 }, { 1, 5 }, { 3, 7 }, { 2, 6 }
+	};
+}
+
+void slice_clipper::set_box(const vec3& _box_min, const vec3& _box_max)
+{
+	box_min = _box_min;
+	box_max = _box_max;
+}
+
+void slice_clipper::clear()
+{
+	origin_x.clear(); origin_y.clear(); origin_z.clear();
+	normal_x.clear(); normal_y.clear(); normal_z.clear();
+	nr_slices = 0;
+}
+
+void slice_clipper::add_slice(const vec3& origin, const vec3& normal)
+{
+	// fill padding lanes of the last block
+	if (nr_slices == origin_x.size()) {
+		size_t n = nr_slices + 4;
+		origin_x.resize(n, 0.0f); origin_y.resize(n, 0.0f); origin_z.resize(n, 0.0f);
+		normal_x.resize(n, 0.0f); normal_y.resize(n, 0.0f); normal_z.resize(n, 0.0f);
+	}
+	origin_x[nr_slices] = origin(0); origin_y[nr_slices] = origin(1); origin_z[nr_slices] = origin(2);
+	normal_x[nr_slices] = normal(0); normal_y[nr_slices] = normal(1); normal_z[nr_slices] = normal(2);
+	++nr_slices;
+}
+
+void slice_clipper::build_polygon(unsigned edge_mask, const float* edge_params, const vec3& normal, slice_polygon& polygon) const
+{
+	polygon.nr_vertices = 0;
+	vec3 extent = box_max - box_min;
+	// place a vertex on each edge between an inside and an outside corner
+	vec3 center(0.0f);
+	for (int e = 0; e < 12; ++e) {
+		if ((edge_mask & (1u << e)) == 0)
+			continue;
+		if (polygon.nr_vertices == 6)
+			break;
+		int a = edge_corners[e][0];
+		vec3& p = polygon.vertices[polygon.nr_vertices++];
+		for (int i = 0; i < 3; ++i)
+			p(i) = (a & (1 << i)) ? box_max(i) : box_min(i);
+		int axis = e / 4;
+		p(axis) = box_min(axis) + edge_params[e] * extent(axis);
+		center += p;
+	}
+	if (polygon.nr_vertices < 3) {
+		polygon.nr_vertices = 0;
+		return;
+	}
+	// order vertices by angle around their center in the plane
+	center /= float(polygon.nr_vertices);
+	vec3 u = std::abs(normal(0)) < 0.9f ? cross(normal, vec3(1, 0, 0)) : cross(normal, vec3(0, 1, 0));
+	vec3 v = cross(normal, u);
+	float angles[6];
+	for (uint32_t i = 0; i < polygon.nr_vertices; ++i) {
+		vec3 d = polygon.vertices[i] - center;
+		angles[i] = std::atan2(dot(d, v), dot(d, u));
+	}
+	for (uint32_t i = 1; i < polygon.nr_vertices; ++i) {
+		float angle = angles[i];
+		vec3 p = polygon.vertices[i];
+		uint32_t j = i;
+		for (; j > 0 && angles[j - 1] > angle; --j) {
+			angles[j] = angles[j - 1];
+			polygon.vertices[j] = polygon.vertices[j - 1];
+		}
+		angles[j] = angle;
+		polygon.vertices[j] = p;
+	}
+}
+
+void slice_clipper::clip_distances(const float* distances, const vec3& normal, slice_polygon& polygon) const
+{
+	// corners with non negative distance are outside
+	unsigned edge_mask = 0;
+	float edge_params[12];
+	for (int e = 0; e < 12; ++e) {
+		float da = distances[edge_corners[e][0]];
+		float db = distances[edge_corners[e][1]];
+		if ((da >= 0) != (db >= 0)) {
+			edge_mask |= 1u << e;
+			edge_params[e] = da / (da - db);
+		}
+	}
+	build_polygon(edge_mask, edge_params, normal, polygon);
+}
+
+void slice_clipper::clip(slice_polygon* polygons) const
+{
+	float corners[3][8];
+	for (int c = 0; c < 8; ++c)
+		for (int i = 0; i < 3; ++i)
+			corners[i][c] = (c & (1 << i)) ? box_max(i) : box_min(i);
+	size_t s = 0;
+#ifdef SLICE_CLIPPER_SSE
+	// signed corner distances and edge intersections of four planes at once
+	alignas(16) float edge_params[12][4];
+	for (; s + 4 <= nr_slices; s += 4) {
+		__m128 nx = _mm_loadu_ps(&normal_x[s]);
+		__m128 ny = _mm_loadu_ps(&normal_y[s]);
+		__m128 nz = _mm_loadu_ps(&normal_z[s]);
+		__m128 k = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(nx, _mm_loadu_ps(&origin_x[s])),
+			_mm_mul_ps(ny, _mm_loadu_ps(&origin_y[s]))),
+			_mm_mul_ps(nz, _mm_loadu_ps(&origin_z[s])));
+		__m128 distances[8];
+		__m128 outside[8];
+		for (int c = 0; c < 8; ++c) {
+			__m128 d = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(nx, _mm_set1_ps(corners[0][c])),
+				_mm_mul_ps(ny, _mm_set1_ps(corners[1][c]))),
+				_mm_mul_ps(nz, _mm_set1_ps(corners[2][c])));
+			distances[c] = _mm_sub_ps(d, k);
+			outside[c] = _mm_cmpge_ps(distances[c], _mm_setzero_ps());
+		}
+		unsigned edge_masks[4] = { 0, 0, 0, 0 };
+		for (int e = 0; e < 12; ++e) {
+			__m128 da = distances[edge_corners[e][0]];
+			__m128 db = distances[edge_corners[e][1]];
+			int crossing = _mm_movemask_ps(_mm_xor_ps(outside[edge_corners[e][0]], outside[edge_corners[e][1]]));
+			// lanes without crossing may divide by zero, their parameters are ignored
+			_mm_store_ps(edge_params[e], _mm_div_ps(da, _mm_sub_ps(da, db)));
+			for (int l = 0; l < 4; ++l)
+				if (crossing & (1 << l))
+					edge_masks[l] |= 1u << e;
+		}
+		for (int l = 0; l < 4; ++l) {
+			float lane_params[12];
+			for (int e = 0; e < 12; ++e)
+				lane_params[e] = edge_params[e][l];
+			build_polygon(edge_masks[l], lane_params, vec3(normal_x[s + l], normal_y[s + l], normal_z[s + l]), polygons[s + l]);
+		}
+	}
+#endif
+	for (; s < nr_slices; ++s) {
+		float k = normal_x[s] * origin_x[s] + normal_y[s] * origin_y[s] + normal_z[s] * origin_z[s];
+		float distances[8];
+		for (int c = 0; c < 8; ++c)
+			distances[c] = normal_x[s] * corners[0][c] + normal_y[s] * corners[1][c] + normal_z[s] * corners[2][c] - k;
+		clip_distances(distances, vec3(normal_x[s], normal_y[s], normal_z[s]), polygons[s]);
+	}
+}
+
+void slice_clipper::clip_slice(const vec3& box_min, const vec3& box_max, const vec3& origin, const vec3& normal, slice_polygon& polygon)
+{
+	slice_clipper clipper;
+	clipper.set_box(box_min, box_max);
+	float distances[8];
+	for (int c = 0; c < 8; ++c) {
+		vec3 corner;
+		for (int i = 0; i < 3; ++i)
+			corner(i) = (c & (1 << i)) ? box_max(i) : box_min(i);
+		distances[c] = dot(normal, corner - origin);
+	}
+	clipper.clip_distances(distances, normal, polygon);
+}
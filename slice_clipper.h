@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cgv/math/fvec.h>
+#include <vector>
+#include <cstdint>
+
+/// polygon of the intersection of a plane with a box, which has at most 6 vertices
+struct slice_polygon
+{
+	uint32_t nr_vertices = 0;
+	cgv::math::fvec<float, 3> vertices[6];
+};
+
+/// clips batches of planes against an axis aligned box, planes are kept in structure of arrays layout
+/// such that four planes are clipped at once with SSE where available
+class slice_clipper
+{
+public:
+	typedef cgv::math::fvec<float, 3> vec3;
+protected:
+	vec3 box_min, box_max;
+	// plane origins and normals padded to a multiple of four planes
+	std::vector<float> origin_x, origin_y, origin_z;
+	std::vector<float> normal_x, normal_y, normal_z;
+	size_t nr_slices = 0;
+	// collect intersection points on the edges set in edge_mask at the given edge parameters and order them to a convex polygon
+	void build_polygon(unsigned edge_mask, const float* edge_params, const vec3& normal, slice_polygon& polygon) const;
+	// build polygon of one plane from the signed distances of the box corners
+	void clip_distances(const float* distances, const vec3& normal, slice_polygon& polygon) const;
+public:
+	/// set box in the coordinate system of the planes
+	void set_box(const vec3& _box_min, const vec3& _box_max);
+	/// remove all planes but keep memory
+	void clear();
+	/// append plane through origin with given normal
+	void add_slice(const vec3& origin, const vec3& normal);
+	size_t get_nr_slices() const { return nr_slices; }
+	/// intersect all planes with the box and write one polygon per plane, which is empty for planes missing the box
+	void clip(slice_polygon* polygons) const;
+	/// intersect a single plane with box [box_min, box_max]
+	static void clip_slice(const vec3& box_min, const vec3& box_max, const vec3& origin, const vec3& normal, slice_polygon& polygon);
+};
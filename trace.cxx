@@ -0,0 +1,101 @@
+#include "trace.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+namespace trace {
+
+std::atomic<int> max_level{ TL_WARNING };
+std::atomic<uint32_t> categories{ TC_ALL };
+std::atomic<bool> echo{ false };
+
+namespace {
+
+struct entry
+{
+	// odd while the entry is written, otherwise twice the index of the message plus two
+	std::atomic<uint64_t> sequence{ 0 };
+	double time;
+	TraceLevel level;
+	TraceCategory category;
+	char message[112];
+};
+
+const size_t ring_size = 4096;
+entry ring[ring_size];
+std::atomic<uint64_t> write_index{ 0 };
+const auto start_time = std::chrono::steady_clock::now();
+
+const char* category_names[nr_categories] = { "ingest", "upload", "bricks", "slicing", "playback", "interaction" };
+const char* level_names[] = { "error", "warning", "info", "debug", "verbose" };
+
+const char* category_name(TraceCategory category)
+{
+	for (unsigned i = 0; i < nr_categories; ++i)
+		if (category == (1u << i))
+			return category_names[i];
+	return "all";
+}
+
+}
+
+const char* get_category_name(unsigned i)
+{
+	return i < nr_categories ? category_names[i] : "";
+}
+
+const char* get_level_name(TraceLevel level)
+{
+	return level_names[level];
+}
+
+void write(TraceCategory category, TraceLevel level, const std::string& message)
+{
+	uint64_t i = write_index.fetch_add(1, std::memory_order_relaxed);
+	entry& e = ring[i % ring_size];
+	e.sequence.store(2 * i + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	e.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+	e.level = level;
+	e.category = category;
+	size_t n = std::min(message.size(), sizeof(e.message) - 1);
+	std::memcpy(e.message, message.data(), n);
+	e.message[n] = 0;
+	e.sequence.store(2 * i + 2, std::memory_order_release);
+	if (echo.load(std::memory_order_relaxed))
+		std::cout << "[" << category_name(category) << "|" << level_names[level] << "] " << message << std::endl;
+}
+
+void dump(std::ostream& os)
+{
+	uint64_t end = write_index.load(std::memory_order_acquire);
+	uint64_t begin = end > ring_size ? end - ring_size : 0;
+	for (uint64_t i = begin; i < end; ++i) {
+		const entry& e = ring[i % ring_size];
+		uint64_t sequence = e.sequence.load(std::memory_order_acquire);
+		// skip entries that are written or already overwritten by newer messages
+		if (sequence != 2 * i + 2)
+			continue;
+		double time = e.time;
+		TraceLevel level = e.level;
+		TraceCategory category = e.category;
+		char message[sizeof(e.message)];
+		std::memcpy(message, e.message, sizeof(message));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (e.sequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+		message[sizeof(message) - 1] = 0;
+		os << std::fixed << std::setprecision(3) << std::setw(12) << time << " ms [" << category_name(category) << "|" << level_names[level] << "] " << message << "\n";
+	}
+	os.flush();
+}
+
+void clear()
+{
+	for (auto& e : ring)
+		e.sequence.store(0, std::memory_order_relaxed);
+}
+
+}
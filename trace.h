@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <atomic>
+#include <cstdint>
+
+/// trace macros compile to nothing in release builds unless VIDEO_LABELER_TRACE is defined
+#if !defined(NDEBUG) || defined(VIDEO_LABELER_TRACE)
+#define VL_TRACE_ENABLED
+#endif
+
+namespace trace {
+
+enum TraceLevel
+{
+	TL_ERROR,
+	TL_WARNING,
+	TL_INFO,
+	TL_DEBUG,
+	TL_VERBOSE
+};
+
+enum TraceCategory
+{
+	TC_INGEST = 1,
+	TC_UPLOAD = 2,
+	TC_BRICKS = 4,
+	TC_SLICING = 8,
+	TC_PLAYBACK = 16,
+	TC_INTERACTION = 32,
+	TC_ALL = 63
+};
+
+/// number of categories and their names, i.e. for the gui
+const unsigned nr_categories = 6;
+const char* get_category_name(unsigned i);
+const char* get_level_name(TraceLevel level);
+
+/// runtime selection of traced messages
+extern std::atomic<int> max_level;
+extern std::atomic<uint32_t> categories;
+/// whether messages are also written to std::cout
+extern std::atomic<bool> echo;
+
+inline bool is_enabled(TraceCategory category, TraceLevel level)
+{
+	return level <= max_level.load(std::memory_order_relaxed) && (categories.load(std::memory_order_relaxed) & category) != 0;
+}
+/// append message to the ring buffer sink, which can be called concurrently from any thread without locking
+void write(TraceCategory category, TraceLevel level, const std::string& message);
+/// write messages currently held in the ring buffer from oldest to newest
+void dump(std::ostream& os);
+/// drop all messages
+void clear();
+
+}
+
+#ifdef VL_TRACE_ENABLED
+/// trace message composed with stream operators, i.e. VL_TRACE(trace::TC_UPLOAD, trace::TL_DEBUG, "frames " << b << " to " << e)
+#define VL_TRACE(category, level, message) \
+	do { \
+		if (trace::is_enabled(category, level)) { \
+			std::ostringstream trace_os; \
+			trace_os << message; \
+			trace::write(category, level, trace_os.str()); \
+		} \
+	} while (0)
+#else
+#define VL_TRACE(category, level, message) do { } while (0)
+#endif
@@ -6,6 +6,11 @@
 #include <cgv/gui/dialog.h>
 #include <cgv/utils/file.h>
 #include <cgv/math/intersection.h>
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <iomanip>
 
 video_labeler::rgb video_labeler::get_modified_color(const rgb& color) const
 {
@@ -29,6 +34,30 @@ video_labeler::video_labeler(const std::string& _name, const rgb& _color)
 	: cgv::base::node(_name)
 {
 	box_color = _color;
+	apply_trace_settings();
+}
+
+video_labeler::~video_labeler()
+{
+	// labels painted since the last save are not lost on exit
+	cancel_fill();
+	save_labels();
+}
+
+void video_labeler::apply_trace_settings()
+{
+	uint32_t mask = 0;
+	for (unsigned i = 0; i < trace::nr_categories; ++i)
+		if (trace_categories[i])
+			mask |= 1u << i;
+	trace::categories = mask;
+	trace::max_level = trace_level;
+	trace::echo = trace_echo;
+}
+
+void video_labeler::dump_trace()
+{
+	trace::dump(std::cout);
 }
 
 std::string video_labeler::get_type_name() const
@@ -38,21 +67,488 @@ std::string video_labeler::get_type_name() const
 
 bool video_labeler::open_file(const std::string& file_name)
 {
+	// workers must not read frames while they are reallocated
+	propagator.clear();
+	grower.cancel();
 	if (!load_video(file_name, frame_offset, frame_count))
 		return false;
+	// labels of another video are saved before they are replaced by the ones stored with this video
+	std::string label_file_name = file_name + ".labels";
+	if (label_store.get_file_name() != label_file_name) {
+		save_labels();
+		labels.set_dimensions(frame_width, frame_height);
+		journal.clear();
+		edit_record = 0;
+		stroke_recording = fill_recording = propagation_recording = false;
+		update_journal_stats();
+		label_store.open(label_file_name, frame_width, frame_height);
+	}
+	propagator.set_luma_source([this](uint32_t frame, std::vector<uint8_t>& luma) { return extract_luma(frame, luma); }, frame_width, frame_height);
 	update_member(&frame_width);
 	update_member(&frame_height);
 	update_member(&frame_count);
 	for (int i = 0; i < 3; ++i) {
 		update_member(&V.ref_extent()[i]);
 		update_member(&position[i]);
-		find_control(slice_indices[i])->set("max", V.get_dimensions()[i]-1);
-		slice_indices[i] = V.get_dimensions()[i] / 2;
+		find_control(slice_indices[i])->set("max", get_dimensions()[i]-1);
+		slice_indices[i] = get_dimensions()[i] / 2;
 		update_member(&slice_indices[i]);
 	}
+	update_member(&nr_loaded_frames);
 	return true;
 }
 
+void video_labeler::add_stroke_sample(const vec3& p)
+{
+	stroke_samples.push_back(p);
+	post_redraw();
+}
+
+void video_labeler::end_stroke()
+{
+	flush_stroke();
+	stroke_has_start = false;
+	if (stroke_recording) {
+		stroke_recording = false;
+		end_label_edit();
+	}
+	// propagate once per stroke as every sample restarts propagation from the painted frames
+	if (propagate_labels)
+		propagator.schedule(labels);
+}
+
+bool video_labeler::pick_slice_point(int slice_index, const vec3& ray_start, const vec3& ray_direction, vec3& hit_point) const
+{
+	return slice_index >= 0 && intersect_slice(size_t(slice_index), ray_start, ray_direction, hit_point);
+}
+
+bool video_labeler::grow_region(const vec3& p)
+{
+	vec3 v = world_to_voxel_coordinate_transform(p);
+	ivec3 dims = get_dimensions();
+	for (int i = 0; i < 3; ++i)
+		if (v(i) < 0 || v(i) >= dims(i))
+			return false;
+	uint32_t offset = get_window_offset();
+	// a still growing region is finished as it is
+	if (fill_recording) {
+		fill_recording = false;
+		end_label_edit();
+	}
+	fill_label = current_label;
+	bool started = grower.start([this](uint32_t frame, std::vector<uint8_t>& colors) { return extract_colors(frame, colors); },
+		frame_width, frame_height, offset, offset + uint32_t(dims(2)), uint32_t(v(0)), uint32_t(v(1)), offset + uint32_t(v(2)), fill_threshold);
+	if (started) {
+		fill_recording = true;
+		begin_label_edit();
+	}
+	VL_TRACE(trace::TC_INTERACTION, trace::TL_INFO, "grow region from voxel " << v << (started ? "" : " failed"));
+	post_redraw();
+	return started;
+}
+
+void video_labeler::save_labels()
+{
+	if (label_store.is_open() && !label_store.save(labels))
+		std::cerr << "could not save labels to " << label_store.get_file_name() << std::endl;
+}
+
+void video_labeler::export_labels()
+{
+	uint32_t frame_begin = get_window_offset();
+	uint32_t frame_end = frame_begin + uint32_t(std::max(get_dimensions()(2), 0));
+	std::string directory = file_name + "_export";
+	bool started;
+	if (export_all_frames && label_store.is_open()) {
+		// the export thread decodes the saved labels chunk by chunk from its own mapping of the label file, which
+		// saves only append to
+		save_labels();
+		auto store = std::make_shared<label_file>();
+		if (!store->open(label_store.get_file_name(), frame_width, frame_height)) {
+			std::cerr << "could not open " << label_store.get_file_name() << " for export" << std::endl;
+			return;
+		}
+		uint32_t chunk_frames = store->get_chunk_frames();
+		started = exporter.start([store](uint32_t b, uint32_t e, label_volume& batch) { store->read(batch, b, e); return true; },
+			frame_width, frame_height, 0, uint32_t(store->get_nr_chunks() * chunk_frames), chunk_frames, true, directory);
+	}
+	else {
+		// labels of the window are small enough to be copied, such that painting can go on during the export
+		auto window = std::make_shared<label_volume>(labels);
+		window->set_change_record(0);
+		started = exporter.start([window](uint32_t, uint32_t, label_volume& batch) { batch = *window; return true; },
+			frame_width, frame_height, frame_begin, frame_end, frame_end - frame_begin, false, directory);
+	}
+	if (!started) {
+		std::cerr << "could not export labels of frames " << frame_begin << " to " << frame_end << std::endl;
+		return;
+	}
+	export_start = std::chrono::steady_clock::now();
+	exporting = true;
+	post_redraw();
+}
+
+void video_labeler::update_export_progress()
+{
+	if (!exporting)
+		return;
+	export_progress = exporter.get_progress();
+	update_member(&export_progress);
+	if (exporter.is_running()) {
+		// keep polling
+		post_redraw();
+		return;
+	}
+	exporting = false;
+	if (!exporter.has_succeeded())
+		std::cerr << "could not export labels to " << file_name << "_export" << std::endl;
+	export_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - export_start).count();
+	update_member(&export_time);
+}
+
+void video_labeler::cancel_export()
+{
+	exporter.cancel();
+}
+
+void video_labeler::cancel_fill()
+{
+	grower.cancel();
+	if (fill_recording) {
+		fill_recording = false;
+		end_label_edit();
+	}
+}
+
+void video_labeler::begin_label_edit()
+{
+	if (!edit_record)
+		edit_record = &journal.begin_label_edit();
+}
+
+void video_labeler::end_label_edit()
+{
+	// stroke, fill and propagation share the open edit
+	if (stroke_recording || fill_recording || propagation_recording || !edit_record)
+		return;
+	edit_record = 0;
+	journal.end_label_edit();
+	update_journal_stats();
+}
+
+uint32_t video_labeler::get_current_frame() const
+{
+	return get_window_offset() + uint32_t(std::max(slice_indices[2], 0));
+}
+
+void video_labeler::update_label_stats()
+{
+	// aggregates are maintained by the label volume on each edit, so only lookups are needed
+	uint32_t f = get_current_frame();
+	if (labels.get_version() == label_stats_labels_version && current_label == label_stats_label && f == label_stats_frame)
+		return;
+	label_stats_labels_version = labels.get_version();
+	label_stats_label = current_label;
+	label_stats_frame = f;
+	uint32_t frame_begin = 0, frame_end = 0;
+	label_voxels = uint32_t(labels.get_nr_voxels(current_label));
+	if (labels.get_frame_span(current_label, frame_begin, frame_end)) {
+		label_first_frame = frame_begin;
+		label_last_frame = frame_end - 1;
+		label_mean_area = float(label_voxels) / labels.get_frame_areas(current_label).size();
+	}
+	else {
+		label_first_frame = label_last_frame = 0;
+		label_mean_area = 0;
+	}
+	label_frame_area = uint32_t(labels.get_nr_voxels(current_label, f));
+	++label_stats_version;
+	update_member(&label_voxels);
+	update_member(&label_first_frame);
+	update_member(&label_last_frame);
+	update_member(&label_frame_area);
+	update_member(&label_mean_area);
+}
+
+std::string video_labeler::get_label_stats_text() const
+{
+	std::ostringstream os;
+	os << "label:         " << current_label << "\n";
+	os << "voxels:        " << label_voxels << "\n";
+	if (label_voxels > 0)
+		os << "frames:        " << label_first_frame << " .. " << label_last_frame << "\n";
+	else
+		os << "frames:        -\n";
+	os << "frame area:    " << label_frame_area << " (frame " << label_stats_frame << ")\n";
+	os << "mean area:     " << std::fixed << std::setprecision(1) << label_mean_area;
+	return os.str();
+}
+
+void video_labeler::update_journal_stats()
+{
+	nr_undo_edits = uint32_t(journal.get_nr_undo_edits());
+	nr_redo_edits = uint32_t(journal.get_nr_redo_edits());
+	journal_memory = float(journal.get_memory_usage()) / (1024 * 1024);
+	update_member(&nr_undo_edits);
+	update_member(&nr_redo_edits);
+	update_member(&journal_memory);
+}
+
+bool video_labeler::create_slice(const vec3& origin, const vec3& direction, bool undoable)
+{
+	if (!video_slicer::create_slice(origin, direction))
+		return false;
+	if (undoable) {
+		finish_label_edits();
+		journal.record_slice_creation(get_num_slices() - 1, origin, direction);
+		update_journal_stats();
+	}
+	return true;
+}
+
+bool video_labeler::delete_slice(int index, bool undoable)
+{
+	if (index < 0 || size_t(index) >= get_num_slices())
+		return false;
+	vec3 origin = slice_origins[index], direction = slice_directions[index];
+	video_slicer::delete_slice(index);
+	if (undoable) {
+		finish_label_edits();
+		journal.record_slice_deletion(size_t(index), origin, direction);
+		update_journal_stats();
+	}
+	return true;
+}
+
+void video_labeler::apply_edit(edit_journal::edit& e, bool revert)
+{
+	switch (e.kind) {
+	case edit_journal::EK_LABELS:
+		// propagated frames are edits of their own, such that restoring them needs no propagation
+		labels.restore(e.labels);
+		break;
+	case edit_journal::EK_CREATE_SLICE:
+		if (revert)
+			video_slicer::delete_slice(int(e.slice_index));
+		else
+			insert_slice(e.slice_index, e.slice_origin, e.slice_direction);
+		break;
+	case edit_journal::EK_DELETE_SLICE:
+		if (revert)
+			insert_slice(e.slice_index, e.slice_origin, e.slice_direction);
+		else
+			video_slicer::delete_slice(int(e.slice_index));
+		break;
+	}
+	update_journal_stats();
+	post_redraw();
+}
+
+void video_labeler::finish_label_edits()
+{
+	if (stroke_has_start || stroke_recording)
+		end_stroke();
+	cancel_fill();
+	if (propagation_recording) {
+		propagation_recording = false;
+		end_label_edit();
+	}
+}
+
+void video_labeler::undo()
+{
+	// finish edits in progress such that they can be undone as a whole, and stop propagation that would otherwise
+	// overwrite the restored frames and drop the redo history
+	finish_label_edits();
+	propagator.cancel();
+	edit_journal::edit* e = journal.undo();
+	if (e)
+		apply_edit(*e, true);
+}
+
+void video_labeler::redo()
+{
+	finish_label_edits();
+	propagator.cancel();
+	edit_journal::edit* e = journal.redo();
+	if (e)
+		apply_edit(*e, false);
+}
+
+void video_labeler::flush_stroke()
+{
+	if (stroke_samples.empty())
+		return;
+	uint16_t label = brush_erase ? 0 : current_label;
+	if (!stroke_recording) {
+		stroke_recording = true;
+		begin_label_edit();
+	}
+	labels.set_change_record(edit_record);
+	for (const vec3& p : stroke_samples) {
+		// a single sample paints a sphere
+		paint_capsule(stroke_has_start ? stroke_start : p, p, brush_radius, label);
+		stroke_start = p;
+		stroke_has_start = true;
+	}
+	labels.set_change_record(0);
+	stroke_samples.clear();
+}
+
+void video_labeler::paint_capsule(const vec3& p0, const vec3& p1, float radius, uint16_t label)
+{
+	// voxel box enclosing the capsule
+	vec3 lower = world_to_voxel_coordinate_transform(vec3(std::min(p0(0), p1(0)), std::min(p0(1), p1(1)), std::min(p0(2), p1(2))) - vec3(radius));
+	vec3 upper = world_to_voxel_coordinate_transform(vec3(std::max(p0(0), p1(0)), std::max(p0(1), p1(1)), std::max(p0(2), p1(2))) + vec3(radius));
+	ivec3 dims = get_dimensions();
+	int b[3], e[3];
+	for (int i = 0; i < 3; ++i) {
+		b[i] = std::max(int(std::floor(lower(i))), 0);
+		e[i] = std::min(int(std::ceil(upper(i))), dims(i));
+	}
+	vec3 d = p1 - p0;
+	float dd = dot(d, d);
+	float r2 = radius * radius;
+	uint32_t frame_offset = get_window_offset();
+	for (int f = b[2]; f < e[2]; ++f) {
+		bool painted = false;
+		for (int y = b[1]; y < e[1]; ++y) {
+			// collect span of voxel centers within the capsule, which is convex and therefore a single span per row
+			int x_begin = -1, x_end = -1;
+			for (int x = b[0]; x < e[0]; ++x) {
+				vec3 q = voxel_to_world_coordinate_transform(ivec3(x, y, f));
+				float t = dd > 0 ? std::max(0.0f, std::min(1.0f, dot(q - p0, d) / dd)) : 0.0f;
+				vec3 r = q - (p0 + t * d);
+				if (dot(r, r) <= r2) {
+					if (x_begin == -1)
+						x_begin = x;
+					x_end = x + 1;
+				}
+				else if (x_begin != -1)
+					break;
+			}
+			if (x_begin != -1) {
+				labels.paint_span(frame_offset + f, y, x_begin, x_end, label);
+				painted = true;
+			}
+		}
+		if (painted && propagate_labels)
+			propagator.add_keyframe(frame_offset + f);
+	}
+}
+
+void video_labeler::init_frame(cgv::render::context& ctx)
+{
+	// rasterize stroke samples of all controller events since the last frame at once
+	flush_stroke();
+	uint32_t old_nr_loaded_frames = nr_loaded_frames;
+	uint32_t old_nr_dirty_frames = nr_dirty_frames;
+	float old_upload_latency = upload_latency;
+	float old_upload_in_flight = upload_in_flight;
+	float old_swap_latency = swap_latency;
+	uint32_t old_brick_cache_usage = brick_cache_usage;
+	uint32_t old_nr_resident_bricks = nr_resident_bricks;
+	bool old_playing = playing;
+	uint32_t old_frame_offset = frame_offset;
+	int old_time_slice = slice_indices[2];
+	uint32_t old_prefetch_queue_depth = prefetch_queue_depth;
+	uint32_t old_prefetch_hits = prefetch_hits;
+	uint32_t old_prefetch_misses = prefetch_misses;
+	uint32_t old_nr_labeled_voxels = nr_labeled_voxels;
+	uint32_t old_nr_labeled_frames = nr_labeled_frames;
+	uint32_t old_nr_keyframes = nr_keyframes;
+	uint32_t old_nr_propagation_jobs = nr_propagation_jobs;
+	uint32_t old_nr_filled_voxels = nr_filled_voxels;
+	uint32_t old_nr_unsaved_frames = nr_unsaved_frames;
+	// decode stored labels of chunks the window reached
+	uint32_t window_begin = get_window_offset();
+	label_store.load(labels, window_begin, window_begin + uint32_t(std::max(get_dimensions()(2), 0)));
+	// paint spans filled since the last frame such that the fill progress shows in the overlay
+	bool filling = grower.is_running();
+	grower.take_spans(filled_spans, 1 << 16);
+	labels.set_change_record(edit_record);
+	uint32_t last_filled_frame = uint32_t(-1);
+	for (const auto& s : filled_spans) {
+		labels.paint_span(s.frame, s.y, s.x_begin, s.x_end, fill_label);
+		// filled frames are not overwritten by propagation
+		if (s.frame != last_filled_frame) {
+			propagator.add_owned_frame(s.frame);
+			last_filled_frame = s.frame;
+		}
+	}
+	labels.set_change_record(0);
+	if (fill_recording && !filling && filled_spans.empty()) {
+		fill_recording = false;
+		end_label_edit();
+	}
+	nr_filled_voxels = uint32_t(grower.get_nr_voxels());
+	if (filling || !filled_spans.empty())
+		post_redraw();
+	// record propagated frames in an edit that ends once propagation is done
+	if (!propagation_recording && propagator.has_results()) {
+		propagation_recording = true;
+		begin_label_edit();
+	}
+	labels.set_change_record(edit_record);
+	size_t nr_propagated_frames = propagator.apply_results(labels);
+	labels.set_change_record(0);
+	nr_keyframes = uint32_t(propagator.get_nr_keyframes());
+	nr_propagation_jobs = uint32_t(propagator.get_nr_jobs());
+	if (propagation_recording && nr_propagation_jobs == 0 && !propagator.has_results()) {
+		propagation_recording = false;
+		end_label_edit();
+	}
+	// keep polling for propagated frames
+	if (nr_propagated_frames > 0 || nr_propagation_jobs > 0)
+		post_redraw();
+	video_slicer::init_frame(ctx);
+	update_label_stats();
+	update_export_progress();
+	nr_labeled_voxels = uint32_t(labels.get_nr_voxels());
+	nr_labeled_frames = uint32_t(labels.get_nr_labeled_frames());
+	if (nr_labeled_voxels != old_nr_labeled_voxels) {
+		label_memory = float(labels.get_memory_usage()) / 1024;
+		update_member(&nr_labeled_voxels);
+		update_member(&label_memory);
+	}
+	if (nr_labeled_frames != old_nr_labeled_frames)
+		update_member(&nr_labeled_frames);
+	nr_unsaved_frames = uint32_t(labels.get_unsaved_frames().size());
+	if (nr_unsaved_frames != old_nr_unsaved_frames)
+		update_member(&nr_unsaved_frames);
+	if (nr_filled_voxels != old_nr_filled_voxels)
+		update_member(&nr_filled_voxels);
+	if (nr_keyframes != old_nr_keyframes)
+		update_member(&nr_keyframes);
+	if (nr_propagation_jobs != old_nr_propagation_jobs)
+		update_member(&nr_propagation_jobs);
+	if (nr_loaded_frames != old_nr_loaded_frames)
+		update_member(&nr_loaded_frames);
+	if (nr_dirty_frames != old_nr_dirty_frames)
+		update_member(&nr_dirty_frames);
+	if (upload_latency != old_upload_latency)
+		update_member(&upload_latency);
+	if (upload_in_flight != old_upload_in_flight)
+		update_member(&upload_in_flight);
+	if (swap_latency != old_swap_latency)
+		update_member(&swap_latency);
+	if (brick_cache_usage != old_brick_cache_usage)
+		update_member(&brick_cache_usage);
+	if (nr_resident_bricks != old_nr_resident_bricks)
+		update_member(&nr_resident_bricks);
+	if (playing != old_playing)
+		update_member(&playing);
+	if (frame_offset != old_frame_offset)
+		update_member(&frame_offset);
+	if (slice_indices[2] != old_time_slice)
+		update_member(&slice_indices[2]);
+	if (prefetch_queue_depth != old_prefetch_queue_depth)
+		update_member(&prefetch_queue_depth);
+	if (prefetch_hits != old_prefetch_hits)
+		update_member(&prefetch_hits);
+	if (prefetch_misses != old_prefetch_misses)
+		update_member(&prefetch_misses);
+}
 
 void video_labeler::on_set(void* member_ptr)
 {
@@ -61,6 +557,17 @@ void video_labeler::on_set(void* member_ptr)
 			std::cerr << "could not open file " << file_name << std::endl;
 		}
 	}
+	if (member_ptr == &frame_offset && sliding_window && !file_name.empty())
+		slide_window(frame_offset);
+	if (member_ptr == &journal_budget)
+		journal.memory_budget = size_t(journal_budget) << 20;
+	if (member_ptr == &trace_level || member_ptr == &trace_echo ||
+		(member_ptr >= &trace_categories[0] && member_ptr < &trace_categories[trace::nr_categories]))
+		apply_trace_settings();
+	if (member_ptr == &playing)
+		set_playback(playing);
+	if (member_ptr == &brick_cache_budget)
+		brick_mem.set_budget(size_t(brick_cache_budget) << 20);
 
 	update_member(member_ptr);
 	post_redraw();
@@ -99,6 +606,31 @@ bool video_labeler::self_reflect(cgv::reflect::reflection_handler& rh)
 	return
 		rh.reflect_member("frame_offset", frame_offset) &&
 		rh.reflect_member("frame_count", frame_count) &&
+		rh.reflect_member("streaming_ingest", streaming_ingest) &&
+		rh.reflect_member("ingest_chunk_size", ingest_chunk_size) &&
+		rh.reflect_member("sliding_window", sliding_window) &&
+		rh.reflect_member("playback_fps", playback_fps) &&
+		rh.reflect_member("prefetch_depth", prefetch_depth) &&
+		rh.reflect_member("upload_budget", upload_budget) &&
+		rh.reflect_member("async_upload", async_upload) &&
+		rh.reflect_member("ycbcr_420", ycbcr_420) &&
+		rh.reflect_member("out_of_core", out_of_core) &&
+		rh.reflect_member("brick_cache_budget", brick_cache_budget) &&
+		rh.reflect_member("brush_radius", brush_radius) &&
+		rh.reflect_member("fill_threshold", fill_threshold) &&
+		rh.reflect_member("journal_budget", journal_budget) &&
+		rh.reflect_member("propagate_labels", propagate_labels) &&
+		rh.reflect_member("propagation_range", propagator.max_distance) &&
+		rh.reflect_member("show_labels", show_labels) &&
+		rh.reflect_member("label_opacity", label_opacity) &&
+		rh.reflect_member("trace_level", (int&)trace_level) &&
+		rh.reflect_member("trace_ingest", trace_categories[0]) &&
+		rh.reflect_member("trace_upload", trace_categories[1]) &&
+		rh.reflect_member("trace_bricks", trace_categories[2]) &&
+		rh.reflect_member("trace_slicing", trace_categories[3]) &&
+		rh.reflect_member("trace_playback", trace_categories[4]) &&
+		rh.reflect_member("trace_interaction", trace_categories[5]) &&
+		rh.reflect_member("trace_echo", trace_echo) &&
 		rh.reflect_member("file_name", file_name);
 }
 
@@ -146,6 +678,12 @@ bool video_labeler::handle(const cgv::gui::event& e, const cgv::nui::dispatch_in
 	}
 	// hid independent check if object is triggered during pointing
 	if (is_trigger_change(e, pressed)) {
+		// in fill mode the trigger seeds region growing at the pointed voxel instead of moving the volume
+		if (fill_mode) {
+			if (pressed)
+				grow_region(hit_point_at_trigger);
+			return true;
+		}
 		if (pressed) {
 			state = state_enum::triggered;
 			on_set(&state);
@@ -189,6 +727,13 @@ bool video_labeler::compute_closest_point(const vec3& point, vec3& prj_point, ve
 }
 bool video_labeler::compute_intersection(const vec3& ray_start, const vec3& ray_direction, float& hit_param, vec3& hit_normal, size_t& primitive_idx)
 {
+	// slices inside the volume are pointed at through the bounding box, primitive index 0 refers to the box
+	size_t slice_index;
+	if (intersect_slices(ray_start, ray_direction, hit_param, hit_normal, slice_index)) {
+		primitive_idx = slice_index + 1;
+		return true;
+	}
+	primitive_idx = 0;
 	vec3 ro = ray_start - position;
 	vec3 rd = ray_direction;
 	vec3 n;
@@ -217,15 +762,89 @@ void video_labeler::create_gui()
 		add_view("Frame Height", frame_height);
 		add_member_control(this, "Frame Count", frame_count, "value_slider", "min=-1;max=1000;log=true;ticks=true");
 		add_member_control(this, "Frame Offset", frame_offset, "value_slider", "min=0;max=1000;log=true;ticks=true");
+		add_member_control(this, "Streaming", streaming_ingest, "check");
+		add_member_control(this, "Chunk Size", ingest_chunk_size, "value_slider", "min=8;max=512;log=true;ticks=true");
+		add_member_control(this, "Sliding Window", sliding_window, "check");
+		add_member_control(this, "Play", playing, "toggle");
+		add_member_control(this, "Playback FPS", playback_fps, "value_slider", "min=-120;max=120;ticks=true");
+		add_member_control(this, "Prefetch Depth", prefetch_depth, "value_slider", "min=0;max=16;ticks=true");
+		add_view("Prefetch Queue", prefetch_queue_depth);
+		add_view("Prefetch Hits", prefetch_hits);
+		add_view("Prefetch Misses", prefetch_misses);
+		add_view("Frames Loaded", nr_loaded_frames);
+		add_member_control(this, "Upload Budget (MB)", upload_budget, "value_slider", "min=1;max=512;log=true;ticks=true");
+		add_view("Frames to Upload", nr_dirty_frames);
+		add_member_control(this, "Async Upload", async_upload, "check");
+		add_view("Upload Latency (ms)", upload_latency);
+		add_view("In Flight (MB)", upload_in_flight);
+		add_view("Swap Latency (ms)", swap_latency);
+		add_member_control(this, "YCbCr 4:2:0", ycbcr_420, "check");
 		align("\b");
 		end_tree_node(file_name);
 	}
+	if (begin_tree_node("Out of Core", out_of_core)) {
+		align("\a");
+		add_member_control(this, "Out of Core", out_of_core, "check");
+		add_member_control(this, "Brick Width", brick_width, "value_slider", "min=16;max=512;log=true;ticks=true");
+		add_member_control(this, "Brick Height", brick_height, "value_slider", "min=16;max=512;log=true;ticks=true");
+		add_member_control(this, "Brick Depth", brick_depth, "value_slider", "min=8;max=256;log=true;ticks=true");
+		add_member_control(this, "Cache Budget (MB)", brick_cache_budget, "value_slider", "min=64;max=16384;log=true;ticks=true");
+		for (unsigned i = 0; i < 3; ++i)
+			add_member_control(this, std::string("Atlas Slots ") + "XYZ"[i], atlas_slots[i], "value_slider", "min=1;max=16;ticks=true");
+		add_member_control(this, "Max Uploads", max_brick_uploads, "value_slider", "min=1;max=64;log=true;ticks=true");
+		add_view("Cache Usage (MB)", brick_cache_usage);
+		add_view("Resident Bricks", nr_resident_bricks);
+		align("\b");
+		end_tree_node(out_of_core);
+	}
+	if (begin_tree_node("Labels", current_label)) {
+		align("\a");
+		add_member_control(this, "Current Label", current_label, "value_slider", "min=1;max=65535;log=true;ticks=true");
+		add_member_control(this, "Brush Radius", brush_radius, "value_slider", "min=0.001;max=0.1;log=true;ticks=true");
+		add_member_control(this, "Erase", brush_erase, "check");
+		add_view("Unsaved Frames", nr_unsaved_frames);
+		connect_copy(add_button("Save Labels")->click, cgv::signal::rebind(this, &video_labeler::save_labels));
+		add_member_control(this, "Export All Frames", export_all_frames, "check");
+		add_member_control(this, "Export Masks", exporter.write_masks, "check");
+		add_member_control(this, "Skip Empty Frames", exporter.skip_empty_frames, "check");
+		connect_copy(add_button("Export Labels")->click, cgv::signal::rebind(this, &video_labeler::export_labels));
+		connect_copy(add_button("Cancel Export")->click, cgv::signal::rebind(this, &video_labeler::cancel_export));
+		add_view("Export Progress", export_progress);
+		add_view("Export Time (s)", export_time);
+		connect_copy(add_button("Undo")->click, cgv::signal::rebind(this, &video_labeler::undo));
+		connect_copy(add_button("Redo")->click, cgv::signal::rebind(this, &video_labeler::redo));
+		add_view("Undo Edits", nr_undo_edits);
+		add_view("Redo Edits", nr_redo_edits);
+		add_view("History (MB)", journal_memory);
+		add_member_control(this, "History Budget (MB)", journal_budget, "value_slider", "min=1;max=4096;log=true;ticks=true");
+		add_member_control(this, "Fill Mode", fill_mode, "check");
+		add_member_control(this, "Fill Threshold", fill_threshold, "value_slider", "min=1;max=128;log=true;ticks=true");
+		add_view("Filled Voxels", nr_filled_voxels);
+		connect_copy(add_button("Cancel Fill")->click, cgv::signal::rebind(this, &video_labeler::cancel_fill));
+		add_member_control(this, "Propagate", propagate_labels, "check");
+		add_member_control(this, "Propagation Range", propagator.max_distance, "value_slider", "min=1;max=300;log=true;ticks=true");
+		add_member_control(this, "Search Radius", propagator.search_radius, "value_slider", "min=1;max=32;ticks=true");
+		add_view("Keyframes", nr_keyframes);
+		add_view("Propagation Jobs", nr_propagation_jobs);
+		add_member_control(this, "Show Labels", show_labels, "check");
+		add_member_control(this, "Opacity", label_opacity, "value_slider", "min=0;max=1;ticks=true");
+		add_view("Label Voxels", label_voxels);
+		add_view("Label First Frame", label_first_frame);
+		add_view("Label Last Frame", label_last_frame);
+		add_view("Label Area in Frame", label_frame_area);
+		add_view("Label Mean Area", label_mean_area);
+		add_view("Labeled Voxels", nr_labeled_voxels);
+		add_view("Labeled Frames", nr_labeled_frames);
+		add_view("Memory (KB)", label_memory);
+		align("\b");
+		end_tree_node(current_label);
+	}
 	if (begin_tree_node("Slicing", slice_indices[0], true)) {
 		align("\a");
 		for (unsigned i = 0; i < 3; ++i) {
 			add_member_control(this, std::string("Slice Index ") + "XYZ"[i], slice_indices[i],
 				"value_slider", "min=-1;max=10;ticks=true;w=140", " ");
-			find_control(slice_indices[i])->set("max", V.get_dimensions()[i]);
+			find_control(slice_indices[i])->set("max", get_dimensions()[i]);
 			add_member_control(this, "show", show_slices[i], "toggle", "w=40");
 		}
 		align("\b");
@@ -246,5 +865,18 @@ void video_labeler::create_gui()
 		align("\b");
 		end_tree_node(position);
 	}
+	if (begin_tree_node("Trace", trace_level)) {
+		align("\a");
+#ifndef VL_TRACE_ENABLED
+		add_decorator("tracing is compiled out in this build", "heading", "level=4");
+#endif
+		add_member_control(this, "Level", (cgv::type::DummyEnum&)trace_level, "dropdown", "enums='error,warning,info,debug,verbose'");
+		for (unsigned i = 0; i < trace::nr_categories; ++i)
+			add_member_control(this, trace::get_category_name(i), trace_categories[i], "check");
+		add_member_control(this, "Echo to Console", trace_echo, "check");
+		connect_copy(add_button("Dump Trace")->click, cgv::signal::rebind(this, &video_labeler::dump_trace));
+		align("\b");
+		end_tree_node(trace_level);
+	}
 
 }
@@ -2,6 +2,11 @@
 
 #include <cgv/base/node.h>
 #include "video_slicer.h"
+#include "label_propagator.h"
+#include "region_grower.h"
+#include "label_file.h"
+#include "label_exporter.h"
+#include "edit_journal.h"
 #include <cgv/media/volume/volume.h>
 #include <cg_nui/focusable.h>
 #include <cg_nui/pointable.h>
@@ -36,13 +41,117 @@ protected:
 	cgv::nui::hid_identifier hid_id;
 	// state of object
 	state_enum state = state_enum::idle;
+	// label used for painting
+	uint16_t current_label = 1;
+	// brush radius in world units and whether the brush erases labels
+	float brush_radius = 0.01f;
+	bool brush_erase = false;
+	// samples of the current stroke in world coordinates that are not rasterized yet; the last rasterized sample starts the next segment
+	std::vector<vec3> stroke_samples;
+	bool stroke_has_start = false;
+	vec3 stroke_start;
+	// rasterize capsules between batched stroke samples into the label volume, called once per frame
+	void flush_stroke();
+	void paint_capsule(const vec3& p0, const vec3& p1, float radius, uint16_t label);
+	// carry labels of painted frames to neighbouring frames in the background
+	label_propagator propagator;
+	bool propagate_labels = true;
+	uint32_t nr_keyframes = 0;
+	uint32_t nr_propagation_jobs = 0;
+	// region growing from the voxel pointed at when triggering in fill mode, filled spans are painted as they arrive
+	region_grower grower;
+	bool fill_mode = false;
+	float fill_threshold = 24.0f;
+	uint16_t fill_label = 1;
+	uint32_t nr_filled_voxels = 0;
+	std::vector<region_grower::span> filled_spans;
+	void cancel_fill();
+	// labels are kept in file_name.labels, whose chunks are loaded as the window reaches them
+	label_file label_store;
+	uint32_t nr_unsaved_frames = 0;
+	void save_labels();
+	// export of masks and bounding box tracks of the window or of all stored frames to file_name_export, which runs in
+	// the background of the exporter and is polled in init_frame
+	label_exporter exporter;
+	bool export_all_frames = false;
+	bool exporting = false;
+	float export_progress = 0;
+	float export_time = 0;
+	std::chrono::steady_clock::time_point export_start;
+	void export_labels();
+	void update_export_progress();
+	void cancel_export();
+	// undo history of strokes, fills, propagated frames and slice edits; strokes, fills and propagation record into the
+	// same label edit while they are active at the same time
+	edit_journal journal;
+	label_volume::change_record* edit_record = 0;
+	bool stroke_recording = false;
+	bool fill_recording = false;
+	bool propagation_recording = false;
+	uint32_t journal_budget = 256;
+	uint32_t nr_undo_edits = 0;
+	uint32_t nr_redo_edits = 0;
+	float journal_memory = 0;
+	void begin_label_edit();
+	void end_label_edit();
+	// end stroke, cancel fill and end recording of propagated frames, such that the journal holds no open label edit
+	// that edit_record points to
+	void finish_label_edits();
+	// revert or reapply edit
+	void apply_edit(edit_journal::edit& e, bool revert);
+	void update_journal_stats();
+	// label statistics shown in gui
+	uint32_t nr_labeled_voxels = 0;
+	uint32_t nr_labeled_frames = 0;
+	float label_memory = 0;
+	// statistics of the current label read from the per label aggregates of the label volume
+	uint32_t label_voxels = 0;
+	uint32_t label_first_frame = 0;
+	uint32_t label_last_frame = 0;
+	uint32_t label_frame_area = 0;
+	float label_mean_area = 0;
+	// state the statistics were computed for and counter of their changes
+	uint64_t label_stats_labels_version = uint64_t(-1);
+	uint16_t label_stats_label = 0;
+	uint32_t label_stats_frame = uint32_t(-1);
+	uint32_t label_stats_version = 0;
+	void update_label_stats();
+	// runtime selection of trace messages, applied to the trace sink in on_set
+	trace::TraceLevel trace_level = trace::TL_WARNING;
+	bool trace_categories[trace::nr_categories] = { true, true, true, true, true, true };
+	bool trace_echo = false;
+	void apply_trace_settings();
+	void dump_trace();
 	/// return color modified based on state
 	rgb get_modified_color(const rgb& color) const;
 public:
 	video_labeler(const std::string& _name, const rgb& _color = rgb(0.5f,0.5f,0.5f));
+	~video_labeler();
 	std::string get_type_name() const;
 	void on_set(void* member_ptr);
 	bool open_file(const std::string& file_name);
+	/// add brush position of current stroke in world coordinates, painting is deferred to the next frame
+	void add_stroke_sample(const vec3& p);
+	/// finish current stroke
+	void end_stroke();
+	/// intersect ray with the given slice, returns false if the ray misses the slice within the volume
+	bool pick_slice_point(int slice_index, const vec3& ray_start, const vec3& ray_direction, vec3& hit_point) const;
+	float get_brush_radius() const { return brush_radius; }
+	/// index of the frame shown in the time slice
+	uint32_t get_current_frame() const;
+	/// changes whenever the statistics of the current label change
+	uint32_t get_label_stats_version() const { return label_stats_version; }
+	/// multi line text with voxel count, frame span and areas of the current label
+	std::string get_label_stats_text() const;
+	/// fill region of similar colors around the voxel at the given point with the current label
+	bool grow_region(const vec3& p);
+	/// create or delete oblique slice and record it in the undo history if undoable
+	bool create_slice(const vec3& origin, const vec3& direction, bool undoable = true);
+	bool delete_slice(int index, bool undoable = true);
+	/// revert last edit or reapply last reverted edit
+	void undo();
+	void redo();
+	void init_frame(cgv::render::context& ctx);
 	bool self_reflect(cgv::reflect::reflection_handler& rh);
 	bool focus_change(cgv::nui::focus_change_action action, cgv::nui::refocus_action rfa, const cgv::nui::focus_demand& demand, const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info);
 	void stream_help(std::ostream& os);
@@ -4,6 +4,11 @@
 #include <cgv/utils/scan.h>
 #include <cgv/gui/dialog.h>
 #include <cgv/utils/file.h>
+#include <cgv/type/standard_types.h>
+#include <cgv_gl/gl/gl.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 video_slicer::vec3 video_slicer::world_to_voxel_coordinate_transform(const vec3& p_world) const
 {
@@ -17,6 +22,88 @@ video_slicer::vec3 video_slicer::voxel_to_world_coordinate_transform(const ivec3
 {
 	return voxel_to_world_coordinate_transform(vec3(i_voxel(0) + 0.5f, i_voxel(1) + 0.5f, i_voxel(2) + 0.5f));
 }
+video_slicer::ivec3 video_slicer::get_dimensions() const
+{
+	return ivec3(int(frame_width), int(frame_height), int(frame_count));
+}
+uint32_t video_slicer::get_window_offset() const
+{
+	return window_offset;
+}
+bool video_slicer::copy_frame(uint32_t frame, std::vector<uint8_t>& data, std::vector<uint8_t>* chroma, unsigned& nr_components)
+{
+	std::lock_guard<std::mutex> lock(vol_mutex);
+	if (bricks.is_open() || frame < window_offset + valid_begin || frame >= window_offset + valid_end)
+		return false;
+	uint32_t slot = get_frame_slot(frame - window_offset);
+	nr_components = V.get_component_format().get_nr_components();
+	const cgv::type::uint8_type* src = V.get_data_ptr<cgv::type::uint8_type>() + size_t(slot) * get_frame_size();
+	data.assign(src, src + get_frame_size());
+	if (chroma && chroma_subsampled) {
+		const cgv::type::uint8_type* chroma_src = C.get_data_ptr<cgv::type::uint8_type>() + size_t(slot) * get_frame_size(C);
+		chroma->assign(chroma_src, chroma_src + get_frame_size(C));
+	}
+	return true;
+}
+bool video_slicer::extract_luma(uint32_t frame, std::vector<uint8_t>& luma)
+{
+	// luma of subsampled frames and of single component formats is the copy itself
+	unsigned nr_components;
+	std::vector<uint8_t> pixels;
+	if (!copy_frame(frame, pixels, 0, nr_components))
+		return false;
+	if (nr_components == 1) {
+		luma.swap(pixels);
+		return true;
+	}
+	size_t nr_pixels = size_t(frame_width) * frame_height;
+	luma.resize(nr_pixels);
+	const uint8_t* src = pixels.data();
+	if (nr_components < 3) {
+		for (size_t i = 0; i < nr_pixels; ++i)
+			luma[i] = src[i * nr_components];
+		return true;
+	}
+	for (size_t i = 0; i < nr_pixels; ++i) {
+		const uint8_t* p = src + i * nr_components;
+		luma[i] = uint8_t((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+	}
+	return true;
+}
+bool video_slicer::extract_colors(uint32_t frame, std::vector<uint8_t>& colors)
+{
+	unsigned nr_components;
+	std::vector<uint8_t> pixels, chroma;
+	if (!copy_frame(frame, pixels, &chroma, nr_components))
+		return false;
+	size_t nr_pixels = size_t(frame_width) * frame_height;
+	colors.resize(3 * nr_pixels);
+	const uint8_t* src = pixels.data();
+	if (!chroma.empty()) {
+		uint32_t chroma_width = (frame_width + 1) / 2;
+		for (uint32_t y = 0; y < frame_height; ++y)
+			for (uint32_t x = 0; x < frame_width; ++x) {
+				size_t i = size_t(y) * frame_width + x;
+				size_t ci = 2 * (size_t(y / 2) * chroma_width + x / 2);
+				colors[3 * i] = src[i];
+				colors[3 * i + 1] = chroma[ci];
+				colors[3 * i + 2] = chroma[ci + 1];
+			}
+		return true;
+	}
+	for (size_t i = 0; i < nr_pixels; ++i)
+		for (unsigned c = 0; c < 3; ++c)
+			colors[3 * i + c] = src[i * nr_components + std::min(c, nr_components - 1)];
+	return true;
+}
+size_t video_slicer::get_frame_size() const
+{
+	return size_t(frame_width) * frame_height * V.get_component_format().get_entry_size();
+}
+size_t video_slicer::get_frame_size(const cgv::media::volume::volume& vol)
+{
+	return size_t(vol.get_dimensions()(0)) * vol.get_dimensions()(1) * vol.get_component_format().get_entry_size();
+}
 
 bool video_slicer::read_video_file(const std::string& file_name, cgv::media::volume::volume& V, uint32_t frame_offset, uint32_t frame_count)
 {
@@ -34,11 +121,83 @@ bool video_slicer::read_video_file(const std::string& file_name, cgv::media::vol
 
 bool video_slicer::load_video(const std::string& file_name, uint32_t _frame_offset, uint32_t _frame_count)
 {
-	if (!read_video_file(file_name, V, _frame_offset, _frame_count))
-		return false;
-	frame_width = V.get_dimensions()(0);
-	frame_height = V.get_dimensions()(1);
-	frame_count = V.get_dimensions()(2);
+	stop_ingest();
+	// pixel buffers must not read from V anymore and their pending results are outdated
+	pbo.wait_for_copies();
+	pbo.invalidate();
+	brick_mem.set_store(0);
+	bricks.close();
+	// streaming and bricking need a known window size to allocate V or the brick store up front
+	bool bricked = out_of_core && _frame_count != uint32_t(-1);
+	// brick store keeps rgb voxels
+	chroma_subsampled = ycbcr_420 && !bricked;
+	ring_offset = 0;
+	window_offset = _frame_offset;
+	if (bricked || (streaming_ingest && _frame_count != uint32_t(-1) && _frame_count > ingest_chunk_size)) {
+		// in out-of-core mode chunks coincide with brick layers
+		uint32_t chunk_size = bricked ? brick_depth : ingest_chunk_size;
+		cgv::media::volume::volume chunk;
+		if (!read_video_file(file_name, chunk, _frame_offset, chunk_size))
+			return false;
+		frame_width = chunk.get_dimensions()(0);
+		frame_height = chunk.get_dimensions()(1);
+		frame_count = _frame_count;
+		uint32_t nr_chunk_frames = std::min(uint32_t(chunk.get_dimensions()(2)), frame_count);
+		if (bricked) {
+			brick_store::layout L;
+			L.frame_width = frame_width;
+			L.frame_height = frame_height;
+			L.frame_offset = _frame_offset;
+			L.frame_count = frame_count;
+			L.brick_width = brick_width;
+			L.brick_height = brick_height;
+			L.brick_depth = brick_depth;
+			L.voxel_size = uint32_t(chunk.get_component_format().get_entry_size());
+			if (!bricks.open(file_name + ".bricks", L))
+				return false;
+			brick_mem.set_store(&bricks);
+			brick_mem.set_budget(size_t(brick_cache_budget) << 20);
+			// release dense voxel data
+			V = cgv::media::volume::volume();
+			if (!bricks.has_layer(0))
+				bricks.write_layer(0, chunk.get_data_ptr<cgv::type::uint8_type>(), nr_chunk_frames);
+		}
+		else {
+			allocate_frames(chunk.get_component_format());
+			store_frames(chunk, 0, nr_chunk_frames);
+		}
+		nr_published_frames = nr_chunk_frames;
+		valid_begin = 0;
+		valid_end = nr_chunk_frames;
+		if (nr_chunk_frames == chunk_size && nr_chunk_frames < frame_count) {
+			ingest_running = true;
+			ingest_thread = std::thread(&video_slicer::ingest_chunks, this, file_name, _frame_offset, nr_chunk_frames, frame_count, chunk_size);
+		}
+	}
+	else if (chroma_subsampled) {
+		cgv::media::volume::volume rgb_volume;
+		if (!read_video_file(file_name, rgb_volume, _frame_offset, _frame_count))
+			return false;
+		frame_width = rgb_volume.get_dimensions()(0);
+		frame_height = rgb_volume.get_dimensions()(1);
+		frame_count = rgb_volume.get_dimensions()(2);
+		allocate_frames(rgb_volume.get_component_format());
+		store_frames(rgb_volume, 0, frame_count);
+		nr_published_frames = frame_count;
+		valid_begin = 0;
+		valid_end = frame_count;
+	}
+	else {
+		C = cgv::media::volume::volume();
+		if (!read_video_file(file_name, V, _frame_offset, _frame_count))
+			return false;
+		frame_width = V.get_dimensions()(0);
+		frame_height = V.get_dimensions()(1);
+		frame_count = V.get_dimensions()(2);
+		nr_published_frames = frame_count;
+		valid_begin = 0;
+		valid_end = frame_count;
+	}
 
 	if (4*frame_count > std::max(frame_width, frame_height))
 		V.ref_extent() = 0.7f * vec3(0.25f*float(frame_width) / frame_count, 0.25f * float(frame_height) / frame_count, 1.0f);
@@ -47,15 +206,316 @@ bool video_slicer::load_video(const std::string& file_name, uint32_t _frame_offs
 
 	position = vec3(0, 0.5f * V.ref_extent()(1)+0.01f, 0);
 	vol_tex_outofdate = true;
+	// labels refer to absolute frames and survive moving the window, but not a change of frame size
+	if (labels.get_width() != frame_width || labels.get_height() != frame_height)
+		labels.set_dimensions(frame_width, frame_height);
+	label_tex_outofdate = true;
+	playing = false;
+	prefetch.set_decoder([this, file_name](uint32_t frame_begin, uint32_t nr_frames, cgv::media::volume::volume& chunk) {
+		return read_video_file(file_name, chunk, frame_begin, nr_frames);
+	});
+	return true;
+}
+
+void video_slicer::allocate_frames(const cgv::data::component_format& cf)
+{
+	if (chroma_subsampled) {
+		V.set_component_format(cgv::data::component_format(cgv::type::info::TI_UINT8, cgv::data::CF_R));
+		C.set_component_format(cgv::data::component_format(cgv::type::info::TI_UINT8, cgv::data::CF_RG));
+		C.resize(cgv::media::volume::volume::dimension_type((frame_width + 1) / 2, (frame_height + 1) / 2, frame_count));
+		// neutral chroma for frames not decoded yet
+		std::fill_n(C.get_data_ptr<cgv::type::uint8_type>(), frame_count * get_frame_size(C), cgv::type::uint8_type(128));
+	}
+	else {
+		V.set_component_format(cf);
+		C = cgv::media::volume::volume();
+	}
+	V.resize(cgv::media::volume::volume::dimension_type(frame_width, frame_height, frame_count));
+	std::fill_n(V.get_data_ptr<cgv::type::uint8_type>(), frame_count * get_frame_size(), cgv::type::uint8_type(0));
+}
+
+void video_slicer::store_frames(const cgv::media::volume::volume& rgb_frames, uint32_t frame_begin, uint32_t nr_frames)
+{
+	if (!chroma_subsampled) {
+		copy_frames(rgb_frames.get_data_ptr<cgv::type::uint8_type>(), 0, frame_begin, nr_frames);
+		return;
+	}
+	std::vector<uint8_t> luma, chroma;
+	convert_frames(rgb_frames, nr_frames, luma, chroma);
+	copy_frames(luma.data(), chroma.data(), frame_begin, nr_frames);
+}
+
+void video_slicer::convert_frames(const cgv::media::volume::volume& rgb_frames, uint32_t nr_frames, std::vector<uint8_t>& luma, std::vector<uint8_t>& chroma) const
+{
+	const cgv::type::uint8_type* src = rgb_frames.get_data_ptr<cgv::type::uint8_type>();
+	// convert to full range BT.601 luma and 2x2 averaged chroma
+	uint32_t chroma_width = (frame_width + 1) / 2;
+	uint32_t chroma_height = (frame_height + 1) / 2;
+	size_t luma_size = size_t(frame_width) * frame_height;
+	size_t chroma_size = 2 * size_t(chroma_width) * chroma_height;
+	luma.resize(nr_frames * luma_size);
+	chroma.resize(nr_frames * chroma_size);
+	for (uint32_t f = 0; f < nr_frames; ++f) {
+		const cgv::type::uint8_type* rgb = src + size_t(f) * luma_size * 3;
+		uint8_t* Y = luma.data() + f * luma_size;
+		uint8_t* CbCr = chroma.data() + f * chroma_size;
+		for (uint32_t cy = 0; cy < chroma_height; ++cy) {
+			for (uint32_t cx = 0; cx < chroma_width; ++cx) {
+				float cb = 0, cr = 0;
+				int n = 0;
+				for (uint32_t y = 2 * cy; y < std::min(2 * cy + 2, frame_height); ++y) {
+					for (uint32_t x = 2 * cx; x < std::min(2 * cx + 2, frame_width); ++x) {
+						size_t i = size_t(y) * frame_width + x;
+						float r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+						Y[i] = uint8_t(std::min(255.0f, 0.299f * r + 0.587f * g + 0.114f * b + 0.5f));
+						cb += -0.168736f * r - 0.331264f * g + 0.5f * b;
+						cr += 0.5f * r - 0.418688f * g - 0.081312f * b;
+						++n;
+					}
+				}
+				size_t ci = 2 * (size_t(cy) * chroma_width + cx);
+				CbCr[ci] = uint8_t(std::max(0.0f, std::min(255.0f, 128.0f + cb / n + 0.5f)));
+				CbCr[ci + 1] = uint8_t(std::max(0.0f, std::min(255.0f, 128.0f + cr / n + 0.5f)));
+			}
+		}
+	}
+}
+
+void video_slicer::copy_frames(const uint8_t* frames, const uint8_t* chroma, uint32_t frame_begin, uint32_t nr_frames)
+{
+	// copy runs of frames up to the wraparound of the ring
+	for (uint32_t f = 0; f < nr_frames; ) {
+		uint32_t slot = get_frame_slot(frame_begin + f);
+		uint32_t n = std::min(nr_frames - f, frame_count - slot);
+		std::copy_n(frames + f * get_frame_size(), n * get_frame_size(), V.get_data_ptr<cgv::type::uint8_type>() + slot * get_frame_size());
+		if (chroma_subsampled)
+			std::copy_n(chroma + f * get_frame_size(C), n * get_frame_size(C), C.get_data_ptr<cgv::type::uint8_type>() + slot * get_frame_size(C));
+		f += n;
+	}
+}
+
+void video_slicer::ingest_chunks(std::string file_name, uint32_t frame_offset, uint32_t frame_begin, uint32_t frame_end, uint32_t chunk_size)
+{
+	cgv::media::volume::volume chunk;
+	uint32_t generation;
+	{
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		generation = window_generation;
+	}
+	for (uint32_t f = frame_begin; f < frame_end && !ingest_abort; f += chunk_size) {
+		uint32_t n = std::min(chunk_size, frame_end - f);
+		// skip brick layers that are already in the brick store from a previous session
+		if (bricks.is_open() && bricks.has_layer(f / chunk_size)) {
+			std::lock_guard<std::mutex> lock(vol_mutex);
+			nr_published_frames = std::max(nr_published_frames, f + n);
+			continue;
+		}
+		if (!read_video_file(file_name, chunk, frame_offset + f, n)) {
+			std::cerr << "video_slicer: could not decode frames " << frame_offset + f << " to " << frame_offset + f + n - 1 << " of " << file_name << std::endl;
+			break;
+		}
+		// the window slid since decoding started
+		if (!publish_frames(chunk, f, frame_end, generation))
+			break;
+		// stop at end of video
+		if (uint32_t(chunk.get_dimensions()(2)) < n)
+			break;
+	}
+	{
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		// slide_window relies on a running thread to decode the frames it exposed
+		if (ingest_abort || generation == window_generation) {
+			ingest_running = false;
+			return;
+		}
+	}
+	ingest_window(file_name, chunk_size);
+}
+
+bool video_slicer::publish_frames(const cgv::media::volume::volume& chunk, uint32_t frame_begin, uint32_t frame_end, uint32_t generation)
+{
+	if (uint32_t(chunk.get_dimensions()(0)) != frame_width || uint32_t(chunk.get_dimensions()(1)) != frame_height)
+		return true;
+	uint32_t n = std::min(uint32_t(chunk.get_dimensions()(2)), frame_end - frame_begin);
+	if (bricks.is_open()) {
+		bricks.write_layer(frame_begin / bricks.get_layout().brick_depth, chunk.get_data_ptr<cgv::type::uint8_type>(), n);
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		nr_published_frames = std::max(nr_published_frames, frame_begin + n);
+		return true;
+	}
+	// convert before locking, such that the render thread only waits for the copy into the ring
+	if (chroma_subsampled)
+		convert_frames(chunk, n, staging_luma, staging_chroma);
+	std::lock_guard<std::mutex> lock(vol_mutex);
+	// frame indices refer to a window that has been left
+	if (generation != window_generation)
+		return false;
+	VL_TRACE(trace::TC_INGEST, trace::TL_DEBUG, "decoded frames " << window_offset + frame_begin << " to " << window_offset + frame_begin + n - 1);
+	if (chroma_subsampled)
+		copy_frames(staging_luma.data(), staging_chroma.data(), frame_begin, n);
+	else
+		copy_frames(chunk.get_data_ptr<cgv::type::uint8_type>(), 0, frame_begin, n);
+	add_dirty_frames(frame_begin, frame_begin + n);
+	// grow range of decoded frames at the side the chunk was decoded
+	if (frame_begin + n > valid_end && frame_begin <= valid_end)
+		valid_end = frame_begin + n;
+	else if (frame_begin < valid_begin && frame_begin + n >= valid_begin)
+		valid_begin = frame_begin;
+	nr_published_frames = valid_end - valid_begin;
 	return true;
 }
 
-video_slicer::video_slicer()
+void video_slicer::ingest_window(std::string file_name, uint32_t chunk_size)
 {
+	cgv::media::volume::volume chunk;
+	while (true) {
+		uint32_t frame_begin, frame_end, offset, generation;
+		{
+			std::lock_guard<std::mutex> lock(vol_mutex);
+			bool grow_front = valid_begin > 0;
+			bool grow_back = valid_end < frame_count;
+			// the thread stops running under the lock, such that slide_window either sees it running and leaves the new
+			// window to it or starts a new thread
+			if (ingest_abort || (!grow_front && !grow_back)) {
+				ingest_running = false;
+				return;
+			}
+			// prefer frames exposed by the last move of the window
+			if (grow_front && (ingest_backward || !grow_back)) {
+				frame_end = valid_begin;
+				frame_begin = frame_end > chunk_size ? frame_end - chunk_size : 0;
+			}
+			else {
+				frame_begin = valid_end;
+				frame_end = std::min(frame_begin + chunk_size, frame_count);
+			}
+			offset = window_offset;
+			generation = window_generation;
+		}
+		uint32_t n = frame_end - frame_begin;
+		bool decoded = prefetch.take_chunk(offset + frame_begin, n, chunk) || read_video_file(file_name, chunk, offset + frame_begin, n);
+		if (!decoded)
+			std::cerr << "video_slicer: could not decode frames " << offset + frame_begin << " to " << offset + frame_end - 1 << " of " << file_name << std::endl;
+		// chunks of a window that slid meanwhile are dropped
+		else if (publish_frames(chunk, frame_begin, frame_end, generation) && uint32_t(chunk.get_dimensions()(2)) == n)
+			continue;
+		// stop after errors and at the end of the video unless the window moved on
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		if (generation == window_generation) {
+			ingest_running = false;
+			return;
+		}
+	}
+}
+
+bool video_slicer::slide_window(uint32_t new_frame_offset)
+{
+	if (bricks.is_open() || frame_count == uint32_t(-1) || V.get_dimensions()(2) != int(frame_count))
+		return false;
+	if (new_frame_offset == window_offset)
+		return true;
+	VL_TRACE(trace::TC_PLAYBACK, trace::TL_INFO, "slide window from frame " << window_offset << " to " << new_frame_offset);
+	// worker must not copy from slots that are about to be overwritten
+	pbo.wait_for_copies();
+	bool backward = new_frame_offset < window_offset;
+	bool start_thread;
+	{
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		int64_t delta = int64_t(new_frame_offset) - int64_t(window_offset);
+		// frames that stay in the window keep their slots
+		ring_offset = uint32_t(((int64_t(ring_offset) + delta) % frame_count + frame_count) % frame_count);
+		window_offset = new_frame_offset;
+		int64_t new_valid_begin = std::max(int64_t(valid_begin) - delta, int64_t(0));
+		int64_t new_valid_end = std::min(int64_t(valid_end) - delta, int64_t(frame_count));
+		if (new_valid_begin >= new_valid_end) {
+			// nothing to reuse, restart decoding at the side the window moved to
+			new_valid_begin = new_valid_end = backward ? frame_count : 0;
+		}
+		valid_begin = uint32_t(new_valid_begin);
+		valid_end = uint32_t(new_valid_end);
+		nr_published_frames = valid_end - valid_begin;
+		// slots of newly exposed frames still hold labels of the frames they were used for before
+		uint32_t nr_exposed = uint32_t(std::min(delta < 0 ? -delta : delta, int64_t(frame_count)));
+		if (backward)
+			add_slots(label_dirty_slots, 0, nr_exposed);
+		else
+			add_slots(label_dirty_slots, frame_count - nr_exposed, frame_count);
+		// a running ingest thread continues with the new window after its current chunk instead of being joined here,
+		// which would block rendering on decoding
+		ingest_backward = backward;
+		++window_generation;
+		start_thread = !ingest_running;
+		ingest_running = true;
+	}
+	if (start_thread) {
+		// the previous thread has returned or is about to
+		if (ingest_thread.joinable())
+			ingest_thread.join();
+		ingest_thread = std::thread(&video_slicer::ingest_window, this, file_name, ingest_chunk_size);
+	}
+	post_redraw();
+	return true;
+}
+
+uint32_t video_slicer::get_frame_slot(uint32_t frame_index) const
+{
+	return (ring_offset + frame_index) % frame_count;
+}
+
+void video_slicer::add_slots(frame_range_set& slots, uint32_t frame_begin, uint32_t frame_end) const
+{
+	if (frame_begin >= frame_end)
+		return;
+	uint32_t slot_begin = get_frame_slot(frame_begin);
+	uint32_t slot_end = slot_begin + (frame_end - frame_begin);
+	// split at wraparound of ring
+	if (slot_end > frame_count) {
+		slots.add(slot_begin, frame_count);
+		slots.add(0, slot_end - frame_count);
+	}
+	else
+		slots.add(slot_begin, slot_end);
+}
+
+void video_slicer::add_dirty_frames(uint32_t frame_begin, uint32_t frame_end)
+{
+	add_slots(dirty_frames, frame_begin, frame_end);
+}
+
+void video_slicer::stop_ingest()
+{
+	ingest_abort = true;
+	if (ingest_thread.joinable())
+		ingest_thread.join();
+	ingest_abort = false;
+	ingest_running = false;
+}
+
+bool video_slicer::is_ingesting() const
+{
+	return ingest_running;
+}
+
+video_slicer::video_slicer() :
+	label_tex("uint8[R]", cgv::render::TF_NEAREST, cgv::render::TF_NEAREST),
+	palette_tex("uint8[R,G,B,A]", cgv::render::TF_NEAREST, cgv::render::TF_NEAREST),
+	page_tex("uint8[R,G,B,A]", cgv::render::TF_NEAREST, cgv::render::TF_NEAREST)
+{
+	label_tex.set_wrap_r(cgv::render::TW_REPEAT);
+	// the time axis of the volume textures is a ring buffer in sliding window mode
+	for (int i = 0; i < 2; ++i) {
+		vol_tex[i].set_wrap_r(cgv::render::TW_REPEAT);
+		chroma_tex[i].set_wrap_r(cgv::render::TW_REPEAT);
+	}
 	brs.culling_mode = cgv::render::CM_FRONTFACE;
 	position = vec3(0, 0.501f, 0);
 }
 
+video_slicer::~video_slicer()
+{
+	stop_ingest();
+}
+
 bool video_slicer::init(cgv::render::context& ctx)
 {
 	cgv::render::ref_box_renderer(ctx, 1);
@@ -67,25 +527,423 @@ void video_slicer::clear(cgv::render::context& ctx)
 {
 	cgv::render::ref_box_renderer(ctx, -1);
 	aam.destruct(ctx);
+	// force upload of all slices to the attribute arrays of a new context
+	for (int i = 0; i < 3; ++i)
+		cached_slice_indices[i] = -2;
 	slice_prog.destruct(ctx);
+	page_tex.destruct(ctx);
+	label_tex.destruct(ctx);
+	palette_tex.destruct(ctx);
+	pbo.destruct(ctx);
 }
 
-void video_slicer::init_frame(cgv::render::context& ctx)
+void video_slicer::upload_frames(cgv::render::context& ctx, uint32_t frame_begin, uint32_t frame_end)
 {
+	VL_TIME_GPU_SCOPE(frame_timing::FS_TEXTURE_UPLOAD);
+	VL_TRACE(trace::TC_UPLOAD, trace::TL_DEBUG, "upload slots " << frame_begin << " to " << frame_end - 1);
+	cgv::data::data_format df(frame_width, frame_height, frame_end - frame_begin, cgv::type::info::TI_UINT8, chroma_subsampled ? cgv::data::CF_R : pixel_format);
+	cgv::data::const_data_view dv(&df, V.get_data_ptr<cgv::type::uint8_type>() + frame_begin * get_frame_size());
+	vol_tex[upload_vol_tex].replace(ctx, 0, 0, frame_begin, dv);
+	if (chroma_subsampled) {
+		cgv::data::data_format chroma_df(C.get_dimensions()(0), C.get_dimensions()(1), frame_end - frame_begin, cgv::type::info::TI_UINT8, cgv::data::CF_RG);
+		cgv::data::const_data_view chroma_dv(&chroma_df, C.get_data_ptr<cgv::type::uint8_type>() + frame_begin * get_frame_size(C));
+		chroma_tex[upload_vol_tex].replace(ctx, 0, 0, frame_begin, chroma_dv);
+		nr_uploaded_bytes += (frame_end - frame_begin) * get_frame_size(C);
+	}
+	nr_uploaded_bytes += (frame_end - frame_begin) * get_frame_size();
+}
+
+unsigned video_slicer::get_gl_format() const
+{
+	switch (V.get_component_format().get_nr_components()) {
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 4: return GL_RGBA;
+	default: return GL_RGB;
+	}
+}
+
+void video_slicer::collect_required_bricks(std::vector<size_t>& required) const
+{
+	required.clear();
+	const auto& L = bricks.get_layout();
+	vec3 brick_extent(float(L.brick_width), float(L.brick_height), float(L.brick_depth));
+	ivec3 nr_bricks(bricks.get_nr_bricks(0), bricks.get_nr_bricks(1), bricks.get_nr_bricks(2));
+	std::vector<bool> marked(bricks.get_nr_bricks(), false);
+	auto add_brick = [&](const ivec3& b) {
+		size_t bi = bricks.get_brick_index(b(0), b(1), b(2));
+		if (!marked[bi]) {
+			marked[bi] = true;
+			required.push_back(bi);
+		}
+	};
+	// axis aligned slices touch one layer of bricks
+	for (int i = 0; i < 3; ++i) {
+		if (!show_slices[i] || slice_indices[i] < 0 || slice_indices[i] >= get_dimensions()(i))
+			continue;
+		int j = (i + 1) % 3;
+		int k = (j + 1) % 3;
+		ivec3 b;
+		b(i) = int(slice_indices[i] / brick_extent(i));
+		for (b(k) = 0; b(k) < nr_bricks(k); ++b(k))
+			for (b(j) = 0; b(j) < nr_bricks(j); ++b(j))
+				add_brick(b);
+	}
+	// transform oblique slice planes to voxel coordinates and test against brick boxes
+	vec3 voxel_extent = V.get_extent() / vec3(get_dimensions());
+	vec3 box_min = position - 0.5f * V.get_extent();
+	vec3 half_brick_extent = 0.5f * brick_extent;
+	for (size_t s = 0; s < slice_origins.size(); ++s) {
+		vec3 n = slice_directions[s] * voxel_extent;
+		float d = dot(slice_directions[s], box_min - slice_origins[s]);
+		float r = dot(vec3(fabs(n(0)), fabs(n(1)), fabs(n(2))), half_brick_extent);
+		ivec3 b;
+		for (b(2) = 0; b(2) < nr_bricks(2); ++b(2))
+			for (b(1) = 0; b(1) < nr_bricks(1); ++b(1))
+				for (b(0) = 0; b(0) < nr_bricks(0); ++b(0))
+					if (fabs(dot(n, (vec3(b) + 0.5f) * brick_extent) + d) <= r)
+						add_brick(b);
+	}
+}
+
+void video_slicer::update_brick_atlas(cgv::render::context& ctx)
+{
+	VL_TIME_GPU_SCOPE(frame_timing::FS_TEXTURE_UPLOAD);
+	const auto& L = bricks.get_layout();
+	auto& atlas_tex = vol_tex[front_vol_tex];
 	if (vol_tex_outofdate) {
-		if (vol_tex.get_width() != V.get_dimensions()(0) ||
-			vol_tex.get_height() != V.get_dimensions()(1) ||
-			vol_tex.get_depth() != V.get_dimensions()(2))
-			vol_tex.destruct(ctx);
-		if (vol_tex.is_created())
-			vol_tex.replace(ctx, 0,0,0, V.get_data_view());
-		else
-			vol_tex.create(ctx, V.get_data_view());
+		upload_vol_tex = front_vol_tex;
+		atlas_tex.destruct(ctx);
+		page_tex.destruct(ctx);
+		atlas_tex.set_component_format(cgv::data::component_format(cgv::type::info::TI_UINT8, pixel_format));
+		atlas_tex.create(ctx, cgv::render::TT_3D, atlas_slots[0] * L.brick_width, atlas_slots[1] * L.brick_height, atlas_slots[2] * L.brick_depth);
+		size_t nr_slots = size_t(atlas_slots[0]) * atlas_slots[1] * atlas_slots[2];
+		slot_bricks.assign(nr_slots, size_t(-1));
+		slot_last_use.assign(nr_slots, 0);
+		brick_slots.clear();
+		page_table.assign(4 * bricks.get_nr_bricks(), 0);
+		page_table_outofdate = true;
 		vol_tex_outofdate = false;
 	}
+	++brick_frame;
+	collect_required_bricks(required_bricks);
+	uint32_t nr_uploads = 0;
+	bool pending = false;
+	for (size_t bi : required_bricks) {
+		auto iter = brick_slots.find(bi);
+		if (iter != brick_slots.end()) {
+			slot_last_use[iter->second] = brick_frame;
+			continue;
+		}
+		if (nr_uploads >= max_brick_uploads) {
+			pending = true;
+			continue;
+		}
+		// take free or least recently used slot
+		uint32_t slot = 0;
+		for (uint32_t s = 1; s < slot_last_use.size(); ++s)
+			if (slot_last_use[s] < slot_last_use[slot])
+				slot = s;
+		// all slots hold bricks of this frame
+		if (slot_last_use[slot] == brick_frame)
+			break;
+		const cgv::type::uint8_type* data = brick_mem.get_brick(bi);
+		if (!data)
+			continue;
+		if (slot_bricks[slot] != size_t(-1)) {
+			brick_slots.erase(slot_bricks[slot]);
+			std::fill_n(&page_table[4 * slot_bricks[slot]], 4, cgv::type::uint8_type(0));
+		}
+		uint32_t sx = slot % atlas_slots[0];
+		uint32_t sy = (slot / atlas_slots[0]) % atlas_slots[1];
+		uint32_t sz = slot / (atlas_slots[0] * atlas_slots[1]);
+		cgv::data::data_format df(L.brick_width, L.brick_height, L.brick_depth, cgv::type::info::TI_UINT8, pixel_format);
+		atlas_tex.replace(ctx, sx * L.brick_width, sy * L.brick_height, sz * L.brick_depth, cgv::data::const_data_view(&df, data));
+		nr_uploaded_bytes += size_t(L.brick_width) * L.brick_height * L.brick_depth * df.get_nr_components();
+		VL_TRACE(trace::TC_BRICKS, trace::TL_DEBUG, "brick " << bi << " uploaded to slot (" << sx << "," << sy << "," << sz << ")");
+		slot_bricks[slot] = bi;
+		slot_last_use[slot] = brick_frame;
+		brick_slots[bi] = slot;
+		page_table[4 * bi] = cgv::type::uint8_type(sx);
+		page_table[4 * bi + 1] = cgv::type::uint8_type(sy);
+		page_table[4 * bi + 2] = cgv::type::uint8_type(sz);
+		page_table[4 * bi + 3] = 255;
+		page_table_outofdate = true;
+		++nr_uploads;
+	}
+	if (page_table_outofdate) {
+		cgv::data::data_format df(bricks.get_nr_bricks(0), bricks.get_nr_bricks(1), bricks.get_nr_bricks(2), cgv::type::info::TI_UINT8, cgv::data::CF_RGBA);
+		cgv::data::const_data_view dv(&df, page_table.data());
+		if (page_tex.is_created())
+			page_tex.replace(ctx, 0, 0, 0, dv);
+		else
+			page_tex.create(ctx, dv);
+		page_table_outofdate = false;
+	}
+	brick_cache_usage = uint32_t(brick_mem.get_memory_usage() >> 20);
+	nr_resident_bricks = uint32_t(brick_slots.size());
+	if (pending)
+		post_redraw();
+}
+
+void video_slicer::upload_dirty_frames(cgv::render::context& ctx)
+{
+	if (!vol_tex[upload_vol_tex].is_created() || dirty_frames.empty())
+		return;
+	size_t nr_budget_frames = std::max(size_t(1), (size_t(upload_budget) << 20) / get_frame_size());
+	uint32_t frame_begin, frame_end;
+	while (nr_budget_frames > 0 && dirty_frames.pop_front(uint32_t(std::min(nr_budget_frames, size_t(frame_count))), frame_begin, frame_end)) {
+		upload_frames(ctx, frame_begin, frame_end);
+		nr_budget_frames -= frame_end - frame_begin;
+	}
+	// continue upload in next frame
+	if (!dirty_frames.empty())
+		post_redraw();
+}
+
+void video_slicer::upload_dirty_frames_async(cgv::render::context& ctx)
+{
+	VL_TIME_GPU_SCOPE(frame_timing::FS_TEXTURE_UPLOAD);
+	pbo.process(ctx);
+	auto& tex = vol_tex[upload_vol_tex];
+	if (tex.is_created()) {
+		size_t frame_size = get_frame_size();
+		uint32_t nr_buffer_frames = uint32_t(std::max(size_t(1), (size_t(upload_budget) << 20) / frame_size));
+		uint32_t frame_begin, frame_end;
+		while (pbo.has_free_slot() && dirty_frames.pop_front(nr_buffer_frames, frame_begin, frame_end)) {
+			uint32_t n = frame_end - frame_begin;
+			bool submitted = pbo.submit(ctx, tex, 0, 0, frame_begin, frame_width, frame_height, n, get_gl_format(), GL_UNSIGNED_BYTE,
+				V.get_data_ptr<cgv::type::uint8_type>() + frame_begin * frame_size, n * frame_size);
+			if (submitted && chroma_subsampled)
+				submitted = pbo.submit(ctx, chroma_tex[upload_vol_tex], 0, 0, frame_begin, C.get_dimensions()(0), C.get_dimensions()(1), n, GL_RG, GL_UNSIGNED_BYTE,
+					C.get_data_ptr<cgv::type::uint8_type>() + frame_begin * get_frame_size(C), n * get_frame_size(C));
+			if (!submitted) {
+				dirty_frames.add(frame_begin, frame_end);
+				break;
+			}
+			nr_uploaded_bytes += n * (frame_size + (chroma_subsampled ? get_frame_size(C) : 0));
+		}
+	}
+	upload_latency = float(pbo.get_average_latency());
+	upload_in_flight = float(pbo.get_bytes_in_flight()) / (1 << 20);
+	if (!dirty_frames.empty() || !pbo.is_idle())
+		post_redraw();
+}
+
+void video_slicer::swap_vol_tex(cgv::render::context& ctx)
+{
+	if (upload_vol_tex == front_vol_tex || !dirty_frames.empty() || !pbo.is_idle())
+		return;
+	// release previous textures to not keep two volumes in video memory
+	vol_tex[front_vol_tex].destruct(ctx);
+	chroma_tex[front_vol_tex].destruct(ctx);
+	front_vol_tex = upload_vol_tex;
+	swap_latency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - rebuild_start).count();
+}
+
+void video_slicer::create_palette(cgv::render::context& ctx)
+{
+	// spread hues of consecutive labels by the golden ratio, label 0 stays transparent
+	std::vector<cgv::type::uint8_type> palette(4 * 256, 0);
+	for (int i = 1; i < 256; ++i) {
+		float h = 6.0f * std::fmod(i * 0.618034f, 1.0f);
+		float x = 1.0f - std::abs(std::fmod(h, 2.0f) - 1.0f);
+		float r = 0, g = 0, b = 0;
+		switch (int(h)) {
+		case 0: r = 1; g = x; break;
+		case 1: r = x; g = 1; break;
+		case 2: g = 1; b = x; break;
+		case 3: g = x; b = 1; break;
+		case 4: r = x; b = 1; break;
+		default: r = 1; b = x; break;
+		}
+		palette[4 * i] = cgv::type::uint8_type(255 * r);
+		palette[4 * i + 1] = cgv::type::uint8_type(255 * g);
+		palette[4 * i + 2] = cgv::type::uint8_type(255 * b);
+		palette[4 * i + 3] = 255;
+	}
+	cgv::data::data_format df(256, 1, cgv::type::info::TI_UINT8, cgv::data::CF_RGBA);
+	cgv::data::data_view dv(&df, palette.data());
+	palette_tex.create(ctx, dv);
+}
+
+void video_slicer::upload_label_region(cgv::render::context& ctx, uint32_t frame, uint32_t slot, const label_volume::region& R)
+{
+	VL_TIME_GPU_SCOPE(frame_timing::FS_TEXTURE_UPLOAD);
+	label_buffer.resize(size_t(R.x_end - R.x_begin) * (R.y_end - R.y_begin));
+	labels.extract_region(frame, R, label_buffer.data());
+	cgv::data::data_format df(R.x_end - R.x_begin, R.y_end - R.y_begin, 1, cgv::type::info::TI_UINT8, cgv::data::CF_R);
+	cgv::data::const_data_view dv(&df, label_buffer.data());
+	label_tex.replace(ctx, R.x_begin, R.y_begin, slot, dv);
+}
+
+void video_slicer::upload_labels(cgv::render::context& ctx)
+{
+	// the overlay follows the ring of dense window frames and is not available in out-of-core mode
+	if (bricks.is_open() || frame_count == uint32_t(-1) || frame_count == 0 || labels.get_width() != frame_width) {
+		labels.clear_modified_regions();
+		return;
+	}
+	if (!palette_tex.is_created())
+		create_palette(ctx);
+	if (label_tex_outofdate) {
+		label_tex.destruct(ctx);
+		label_tex.create(ctx, cgv::render::TT_3D, frame_width, frame_height, frame_count);
+		label_dirty_slots.clear();
+		label_dirty_slots.add(0, frame_count);
+		label_tex_outofdate = false;
+	}
+	// only upload the changed rectangle of frames in the window
+	for (const auto& mr : labels.get_modified_regions()) {
+		if (mr.first < window_offset || mr.first >= window_offset + frame_count)
+			continue;
+		uint32_t slot = get_frame_slot(mr.first - window_offset);
+		if (!label_dirty_slots.contains(slot))
+			upload_label_region(ctx, mr.first, slot, mr.second);
+	}
+	labels.clear_modified_regions();
+	// complete slots within the upload budget
+	size_t nr_budget_frames = std::max(size_t(1), (size_t(upload_budget) << 20) / (size_t(frame_width) * frame_height));
+	label_volume::region R = { 0, frame_width, 0, frame_height };
+	uint32_t slot_begin, slot_end;
+	while (nr_budget_frames > 0 && label_dirty_slots.pop_front(uint32_t(std::min(nr_budget_frames, size_t(frame_count))), slot_begin, slot_end)) {
+		for (uint32_t slot = slot_begin; slot < slot_end; ++slot)
+			upload_label_region(ctx, window_offset + (slot + frame_count - ring_offset) % frame_count, slot, R);
+		nr_budget_frames -= slot_end - slot_begin;
+	}
+	if (!label_dirty_slots.empty())
+		post_redraw();
+}
+
+void video_slicer::set_playback(bool play)
+{
+	playing = play && frame_count != uint32_t(-1) && !bricks.is_open();
+	play_frame = window_offset + std::max(slice_indices[2], 0) + 0.5;
+	last_play_time = std::chrono::steady_clock::now();
+	if (playing)
+		post_redraw();
+}
+
+bool video_slicer::get_playback() const
+{
+	return playing;
+}
+
+void video_slicer::prefetch_chunks(int direction)
+{
+	uint32_t chunk_size = ingest_chunk_size;
+	int64_t window_begin = window_offset;
+	int64_t window_end = int64_t(window_offset) + frame_count;
+	// chunks that ingest_window decodes after the window slid by whole chunks in playback direction
+	for (uint32_t k = 0; k < prefetch_depth; ++k) {
+		if (direction > 0)
+			prefetch.request_chunk(uint32_t(window_end + k * chunk_size), chunk_size);
+		else if (window_begin >= int64_t(k + 1) * chunk_size)
+			prefetch.request_chunk(uint32_t(window_begin - (k + 1) * chunk_size), chunk_size);
+	}
+	int64_t margin = int64_t(prefetch_depth + 1) * chunk_size;
+	prefetch.retain(uint32_t(std::max(window_begin - margin, int64_t(0))), uint32_t(window_end + margin));
+}
+
+void video_slicer::advance_playback()
+{
+	auto now = std::chrono::steady_clock::now();
+	// limit step after long frames to not skip over undecoded frames
+	double dt = std::min(std::chrono::duration<double>(now - last_play_time).count(), 0.1);
+	last_play_time = now;
+	if (!playing)
+		return;
+	if (sliding_window) {
+		prefetch_chunks(playback_fps < 0 ? -1 : 1);
+		// keep the play head close to the center of the window by sliding it in whole chunks
+		double center = window_offset + 0.5 * frame_count;
+		uint32_t chunk_size = ingest_chunk_size;
+		if (play_frame > center + chunk_size)
+			slide_window(window_offset + chunk_size);
+		else if (play_frame < center - chunk_size && window_offset >= chunk_size)
+			slide_window(window_offset - chunk_size);
+		frame_offset = window_offset;
+	}
+	uint32_t frame_begin, frame_end;
+	{
+		std::lock_guard<std::mutex> lock(vol_mutex);
+		frame_begin = window_offset + valid_begin;
+		frame_end = window_offset + valid_end;
+	}
+	double next_frame = play_frame + dt * playback_fps;
+	// wait for frames that are not decoded yet, stop at the ends of the video
+	if (next_frame >= frame_end || next_frame < frame_begin) {
+		next_frame = std::max(double(frame_begin), std::min(next_frame, frame_end - 0.001));
+		// without background decoding no further frames will arrive
+		if (!is_ingesting())
+			playing = false;
+	}
+	play_frame = next_frame;
+	slice_indices[2] = int(play_frame) - int(window_offset);
+	post_redraw();
+}
+
+void video_slicer::init_frame(cgv::render::context& ctx)
+{
+	VL_TIME_GPU_SCOPE(frame_timing::FS_SLICER_INIT_FRAME);
+	advance_playback();
+	std::lock_guard<std::mutex> lock(vol_mutex);
+	if (bricks.is_open())
+		update_brick_atlas(ctx);
+	else {
+		// only allocate texture here and spread the upload of all frames over the following frames
+		if (vol_tex_outofdate) {
+			// in async mode the front texture keeps rendering until the back texture is complete
+			upload_vol_tex = async_upload && vol_tex[front_vol_tex].is_created() ? 1 - front_vol_tex : front_vol_tex;
+			auto& tex = vol_tex[upload_vol_tex];
+			if (tex.get_width() != unsigned(V.get_dimensions()(0)) ||
+				tex.get_height() != unsigned(V.get_dimensions()(1)) ||
+				tex.get_depth() != unsigned(V.get_dimensions()(2)) ||
+				tex.get_nr_components() != V.get_component_format().get_nr_components())
+				tex.destruct(ctx);
+			if (!tex.is_created()) {
+				tex.set_component_format(V.get_component_format());
+				tex.create(ctx, cgv::render::TT_3D, frame_width, frame_height, frame_count);
+			}
+			auto& chroma = chroma_tex[upload_vol_tex];
+			chroma.destruct(ctx);
+			if (chroma_subsampled) {
+				chroma.set_component_format(C.get_component_format());
+				chroma.create(ctx, cgv::render::TT_3D, C.get_dimensions()(0), C.get_dimensions()(1), C.get_dimensions()(2));
+			}
+			dirty_frames.clear();
+			dirty_frames.add(0, frame_count);
+			pbo.invalidate();
+			rebuild_start = std::chrono::steady_clock::now();
+			vol_tex_outofdate = false;
+		}
+		if (async_upload)
+			upload_dirty_frames_async(ctx);
+		else
+			upload_dirty_frames(ctx);
+		swap_vol_tex(ctx);
+		upload_labels(ctx);
+	}
+	nr_loaded_frames = nr_published_frames;
+	if (bricks.is_open()) {
+		shown_frames[0] = 0.0f;
+		shown_frames[1] = 1.0f;
+	}
+	else if (frame_count != uint32_t(-1) && frame_count > 0) {
+		shown_frames[0] = float(valid_begin) / frame_count;
+		shown_frames[1] = float(valid_end) / frame_count;
+	}
+	nr_dirty_frames = uint32_t(dirty_frames.get_nr_frames());
+	prefetch_queue_depth = uint32_t(prefetch.get_queue_depth());
+	prefetch_hits = uint32_t(prefetch.get_nr_hits());
+	prefetch_misses = uint32_t(prefetch.get_nr_misses());
+	// keep redrawing until all frames arrived
+	if (is_ingesting())
+		post_redraw();
 }
 void video_slicer::draw(cgv::render::context& ctx)
 {
+	VL_TIME_GPU_SCOPE(frame_timing::FS_SLICER_DRAW);
 	// show box
 	auto& br = cgv::render::ref_box_renderer(ctx);
 	br.set_render_style(brs);
@@ -94,70 +952,68 @@ void video_slicer::draw(cgv::render::context& ctx)
 	br.set_extent(ctx, V.get_extent());
 	br.render(ctx, 0, 1);
 
-	if (!vol_tex.is_created())
+	auto& front_tex = vol_tex[front_vol_tex];
+	if (!front_tex.is_created())
 		return;
 
-	// construct slice geometry
-	std::vector<vec3> P;
-	std::vector<float> O;
-	for (int i = 0; i < 3; ++i) {
-		if (!show_slices[i] || slice_indices[i] == uint32_t(-1))
-			continue;
-		box3 B(vec3(0.0f), vec3(float(V.get_dimensions()(0)), float(V.get_dimensions()(1)), float(V.get_dimensions()(2))));
-		B.ref_min_pnt()(i) = B.ref_max_pnt()(i) = slice_indices[i] + 0.5f;
-		int j = (i + 1) % 3;
-		int k = (j + 1) % 3;
-		int off_j = int(pow(2, j));
-		int off_k = int(pow(2, k));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(0)));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j)));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j + off_k)));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(0)));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j + off_k)));
-		P.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_k)));
-		for (int s = 0; s < 6; ++s)
-			O.push_back(1.0f);
-	}
-	// construct oblique slice geometry
-	for (int i = 0; i < slice_origins.size(); ++i)
-	{
-		std::vector<vec3> polygon;
-		construct_slice(i, polygon);
-
-		if (!polygon.empty())
-		{
-			for (int i = polygon.size() - 1; i > 1; --i)
-			{
-				P.push_back(polygon[0]);
-				P.push_back(polygon[i]);
-				P.push_back(polygon[i - 1]);
-				for (int s = 0; s < 3; ++s)
-					O.push_back(1.0f);
-
-#ifdef DEBUG
-				std::cout << "texcoord " << (polygon[0] - (position - 0.5f * V.get_extent())) / V.get_extent() << std::endl;
-				std::cout << "texcoord " << (polygon[i] - (position - 0.5f * V.get_extent())) / V.get_extent() << std::endl;
-				std::cout << "texcoord " << (polygon[i - 1] - (position - 0.5f * V.get_extent())) / V.get_extent() << std::endl;
-#endif
-			}
-		}
+	// only upload geometry of slices that changed since last frame
+	if (update_slice_geometry() && !slice_vertices.empty()) {
+		aam.set_attribute_array(ctx, slice_prog.get_attribute_location(ctx, "position"), slice_vertices);
+		aam.set_attribute_array(ctx, slice_prog.get_attribute_location(ctx, "opacity"), slice_opacities);
 	}
 	// render slice geometry
-	if (!P.empty()) {
+	if (!slice_vertices.empty()) {
 		GLboolean is_culling;
 		glGetBooleanv(GL_CULL_FACE, &is_culling);
 		glDisable(GL_CULL_FACE);
-		aam.set_attribute_array(ctx, slice_prog.get_attribute_location(ctx, "position"), P);
-		aam.set_attribute_array(ctx, slice_prog.get_attribute_location(ctx, "opacity"), O);
 		aam.enable(ctx);
-		vol_tex.enable(ctx, 0);
+		bool bricked = bricks.is_open() && page_tex.is_created();
+		front_tex.enable(ctx, 0);
+		if (bricked)
+			page_tex.enable(ctx, 1);
+		bool ycbcr = chroma_subsampled && chroma_tex[front_vol_tex].is_created();
+		if (ycbcr)
+			chroma_tex[front_vol_tex].enable(ctx, 2);
+		bool overlay = show_labels && !bricked && label_tex.is_created() && palette_tex.is_created() && labels.get_nr_voxels() > 0;
+		if (overlay) {
+			label_tex.enable(ctx, 3);
+			palette_tex.enable(ctx, 4);
+		}
 		slice_prog.enable(ctx);
 		slice_prog.set_uniform(ctx, "box_min_point", position - 0.5f * V.get_extent());
 		slice_prog.set_uniform(ctx, "box_extent", V.get_extent());
 		slice_prog.set_uniform(ctx, "vol_tex", 0);
-		glDrawArrays(GL_TRIANGLES, 0, GLsizei(P.size()));
+		slice_prog.set_uniform(ctx, "bricked", bricked);
+		slice_prog.set_uniform(ctx, "ycbcr", ycbcr);
+		slice_prog.set_uniform(ctx, "show_labels", overlay);
+		if (overlay) {
+			slice_prog.set_uniform(ctx, "label_tex", 3);
+			slice_prog.set_uniform(ctx, "palette_tex", 4);
+			slice_prog.set_uniform(ctx, "label_opacity", label_opacity);
+		}
+		slice_prog.set_uniform(ctx, "valid_frames", vec2(shown_frames[0], shown_frames[1]));
+		slice_prog.set_uniform(ctx, "half_frame", 0.5f / get_dimensions()(2));
+		slice_prog.set_uniform(ctx, "ring_offset", bricked ? 0.0f : float(ring_offset) / get_dimensions()(2));
+		if (ycbcr)
+			slice_prog.set_uniform(ctx, "chroma_tex", 2);
+		if (bricked) {
+			const auto& L = bricks.get_layout();
+			slice_prog.set_uniform(ctx, "page_tex", 1);
+			slice_prog.set_uniform(ctx, "volume_dims", vec3(get_dimensions()));
+			slice_prog.set_uniform(ctx, "brick_dims", vec3(float(L.brick_width), float(L.brick_height), float(L.brick_depth)));
+			slice_prog.set_uniform(ctx, "atlas_slots", vec3(float(atlas_slots[0]), float(atlas_slots[1]), float(atlas_slots[2])));
+		}
+		glDrawArrays(GL_TRIANGLES, 0, GLsizei(slice_vertices.size()));
 		slice_prog.disable(ctx);
-		vol_tex.disable(ctx);
+		if (overlay) {
+			palette_tex.disable(ctx);
+			label_tex.disable(ctx);
+		}
+		if (ycbcr)
+			chroma_tex[front_vol_tex].disable(ctx);
+		if (bricked)
+			page_tex.disable(ctx);
+		front_tex.disable(ctx);
 		aam.disable(ctx);
 		if (is_culling)
 			glEnable(GL_CULL_FACE);
@@ -165,13 +1021,18 @@ void video_slicer::draw(cgv::render::context& ctx)
 }
 bool video_slicer::create_slice(const vec3& origin, const vec3& direction, const rgba& color)
 {
-	box3 B(vec3(0.0f), vec3(float(V.get_dimensions()(0)), float(V.get_dimensions()(1)), float(V.get_dimensions()(2))));
+	box3 B(vec3(0.0f), vec3(get_dimensions()));
 
 	if (!B.inside(world_to_voxel_coordinate_transform(origin)))
 		return false;
 
 	slice_origins.emplace_back(origin);
 	slice_directions.emplace_back(direction);
+	if (bvh_valid) {
+		slice_polygon polygon;
+		clip_slice(slice_origins.size() - 1, polygon);
+		picking_bvh.insert_item(slice_origins.size() - 1, polygon, direction);
+	}
 
 	//post_recreate_gui();
 
@@ -185,110 +1046,234 @@ bool video_slicer::delete_slice(int index, size_t count)
 
 	slice_origins.erase(slice_origins.begin() + index, slice_origins.begin() + index + count);
 	slice_directions.erase(slice_directions.begin() + index, slice_directions.begin() + index + count);
+	if (bvh_valid)
+		picking_bvh.remove_items(index, count);
 
 	//post_recreate_gui();
 
 	return true;
 }
 
-size_t video_slicer::get_num_slices() const
+bool video_slicer::set_slice(size_t index, const vec3& origin, const vec3& direction)
 {
-	return slice_origins.size();
-}
-
-void video_slicer::construct_slice(size_t index, std::vector<vec3>& polygon) const
-{
-	/************************************************************************************
-	 Classify the volume box corners (vertices) as inside or outside vertices.
-	 The signed_distance_from_slice()-method calculates the distance between each box corner and the slice.
-	 Assume that outside vertices have a positive distance. */
+	box3 B(vec3(0.0f), vec3(get_dimensions()));
 
-	box3 B(vec3(0.0f), vec3(float(V.get_dimensions()(0)), float(V.get_dimensions()(1)), float(V.get_dimensions()(2))));
-
-	float values[8];
-	bool corner_classifications[8]; // true = outside, false = inside
-
-	for (int c = 0; c < 8; ++c)
-	{
-		float value = signed_distance_from_slice(index, voxel_to_world_coordinate_transform(B.get_corner(c)));
+	if (index >= slice_origins.size() || !B.inside(world_to_voxel_coordinate_transform(origin)))
+		return false;
 
-		values[c] = value;
-		corner_classifications[c] = value >= 0;
+	slice_origins[index] = origin;
+	slice_directions[index] = direction;
+	if (bvh_valid) {
+		slice_polygon polygon;
+		clip_slice(index, polygon);
+		picking_bvh.update_item(index, polygon, direction);
 	}
 
-	/************************************************************************************
-	 Construct the edge points on each edge connecting differently classified
-				   corners. Remember that the edge point coordinates are in range [0,1] for
-				   all dimensions since they are 3D-texture coordinates. These points are
-				   stored in the polygon-vector.
-	 Arrange the points along face adjacencies for easier tessellation of the
-				   polygon. Store the ordered edge points in the polygon-vector. Create your own
-				   helper structures for edge-face adjacenies etc.*/
+	return true;
+}
 
-	static int a_corner_comparisons[12] = { 0, 2, 6, 4, 0, 4, 5, 1, 0, 1, 3, 2 };
-	static int b_corner_comparisons[12] = { 1, 3, 7, 5, 2, 6, 7, 3, 4, 5, 7, 6 };
+bool video_slicer::insert_slice(size_t index, const vec3& origin, const vec3& direction)
+{
+	if (index > slice_origins.size())
+		return false;
 
-	std::vector<vec3> p;
+	slice_origins.insert(slice_origins.begin() + index, origin);
+	slice_directions.insert(slice_directions.begin() + index, direction);
+	if (bvh_valid) {
+		slice_polygon polygon;
+		clip_slice(index, polygon);
+		picking_bvh.insert_item(index, polygon, direction);
+	}
 
-	for (int i = 0; i < 12; ++i)
-	{
-		int a_corner_index = a_corner_comparisons[i];
-		int b_corner_index = b_corner_comparisons[i];
+	return true;
+}
 
-		if (corner_classifications[a_corner_index] != corner_classifications[b_corner_index])
-		{
-			vec3 coord = B.get_corner(a_corner_index);
-			float a_value = abs(values[a_corner_index]);
-			float b_value = abs(values[b_corner_index]);
+bool video_slicer::is_uploading() const
+{
+	// frames being decoded are marked dirty only once they are published
+	if (is_ingesting() || !pbo.is_idle() || upload_vol_tex != front_vol_tex)
+		return true;
+	std::lock_guard<std::mutex> lock(vol_mutex);
+	return !dirty_frames.empty();
+}
 
-			float new_value = a_value / (a_value + b_value);
+size_t video_slicer::get_num_slices() const
+{
+	return slice_origins.size();
+}
 
-			coord(i / 4) = new_value * B.get_extent()(i / 4) + B.get_min_pnt()(i / 4);
+void video_slicer::construct_axis_slice(int i, std::vector<vec3>& triangles) const
+{
+	triangles.clear();
+	if (!show_slices[i] || slice_indices[i] < 0)
+		return;
+	box3 B(vec3(0.0f), vec3(get_dimensions()));
+	B.ref_min_pnt()(i) = B.ref_max_pnt()(i) = slice_indices[i] + 0.5f;
+	int j = (i + 1) % 3;
+	int k = (j + 1) % 3;
+	int off_j = int(pow(2, j));
+	int off_k = int(pow(2, k));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(0)));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j)));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j + off_k)));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(0)));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_j + off_k)));
+	triangles.push_back(voxel_to_world_coordinate_transform(B.get_corner(off_k)));
+}
 
-			p.push_back(coord);
-		}
+void video_slicer::append_slice_triangles(size_t index, const slice_polygon& polygon)
+{
+	for (int i = int(polygon.nr_vertices) - 1; i > 1; --i) {
+		slice_vertices.push_back(polygon.vertices[0]);
+		slice_vertices.push_back(polygon.vertices[i]);
+		slice_vertices.push_back(polygon.vertices[i - 1]);
+		VL_TRACE(trace::TC_SLICING, trace::TL_VERBOSE, "slice " << index << " texcoords "
+			<< (polygon.vertices[0] - (position - 0.5f * V.get_extent())) / V.get_extent() << ", "
+			<< (polygon.vertices[i] - (position - 0.5f * V.get_extent())) / V.get_extent() << ", "
+			<< (polygon.vertices[i - 1] - (position - 0.5f * V.get_extent())) / V.get_extent());
 	}
+}
 
-	if (p.empty())
-		return;
-
-	vec3 p0 = p[0];
-	p.erase(p.begin());
+bool video_slicer::update_slice_geometry()
+{
+	VL_TIME_SCOPE(frame_timing::FS_SLICE_GEOMETRY);
+	bool changed = false;
+	// all slices move with the volume
+	if (cached_position != position || cached_extent != V.get_extent() || cached_dims != get_dimensions()) {
+		cached_position = position;
+		cached_extent = V.get_extent();
+		cached_dims = get_dimensions();
+		for (int i = 0; i < 3; ++i)
+			cached_slice_indices[i] = -2;
+		oblique_slice_geometry.clear();
+	}
+	for (int i = 0; i < 3; ++i) {
+		int index = show_slices[i] ? slice_indices[i] : -1;
+		if (cached_slice_indices[i] == index)
+			continue;
+		cached_slice_indices[i] = index;
+		construct_axis_slice(i, axis_slice_triangles[i]);
+		changed = true;
+	}
+	if (oblique_slice_geometry.size() != slice_origins.size()) {
+		oblique_slice_geometry.resize(slice_origins.size());
+		changed = true;
+	}
+	// clip all changed oblique slices in one batch
+	clipper.clear();
+	clipper.set_box(position - 0.5f * V.get_extent(), position + 0.5f * V.get_extent());
+	changed_slices.clear();
+	for (size_t i = 0; i < slice_origins.size(); ++i) {
+		auto& sg = oblique_slice_geometry[i];
+		if (sg.valid && sg.origin == slice_origins[i] && sg.direction == slice_directions[i])
+			continue;
+		sg.origin = slice_origins[i];
+		sg.direction = slice_directions[i];
+		sg.valid = true;
+		clipper.add_slice(sg.origin, sg.direction);
+		changed_slices.push_back(i);
+	}
+	if (!changed_slices.empty()) {
+		clipped_polygons.resize(changed_slices.size());
+		clipper.clip(clipped_polygons.data());
+		for (size_t j = 0; j < changed_slices.size(); ++j)
+			oblique_slice_geometry[changed_slices[j]].polygon = clipped_polygons[j];
+		changed = true;
+	}
+	if (!changed)
+		return false;
+	slice_vertices.clear();
+	for (int i = 0; i < 3; ++i)
+		slice_vertices.insert(slice_vertices.end(), axis_slice_triangles[i].begin(), axis_slice_triangles[i].end());
+	for (size_t i = 0; i < oblique_slice_geometry.size(); ++i)
+		append_slice_triangles(i, oblique_slice_geometry[i].polygon);
+	slice_opacities.assign(slice_vertices.size(), 1.0f);
+	return true;
+}
 
-	polygon.push_back(voxel_to_world_coordinate_transform(p0));
+void video_slicer::clip_slice(size_t index, slice_polygon& polygon) const
+{
+	// intersect slice plane with the volume box in world coordinates
+	slice_clipper::clip_slice(position - 0.5f * V.get_extent(), position + 0.5f * V.get_extent(), slice_origins[index], slice_directions[index], polygon);
+}
 
-	while (p.size() > 1)
-	{
-		bool found = false;
+const slice_bvh& video_slicer::get_picking_bvh() const
+{
+	if (bvh_valid && bvh_position == position && bvh_extent == V.get_extent() && bvh_dims == get_dimensions())
+		return picking_bvh;
+	// all slice polygons change with the placement of the volume
+	bvh_position = position;
+	bvh_extent = V.get_extent();
+	bvh_dims = get_dimensions();
+	picking_bvh.clear();
+	slice_polygon polygon;
+	for (size_t i = 0; i < slice_origins.size(); ++i) {
+		clip_slice(i, polygon);
+		picking_bvh.insert_item(i, polygon, slice_directions[i]);
+	}
+	picking_bvh.rebuild();
+	bvh_valid = true;
+	VL_TRACE(trace::TC_SLICING, trace::TL_DEBUG, "rebuilt picking hierarchy of " << slice_origins.size() << " slices with height " << picking_bvh.get_height());
+	return picking_bvh;
+}
 
-		for (unsigned int i = 0; i < 3; ++i)
-		{
-			if (p0(i) < B.get_min_pnt()(i) + EPSILON ||
-				p0(i) > B.get_max_pnt()(i) - EPSILON)
-			{
-				for (unsigned int j = 0; j < p.size(); ++j)
-				{
-					vec3 f = p[j];
-
-					if (fabs(f(i) - p0(i)) < EPSILON)
-					{
-						p.erase(p.begin() + j);
-
-						polygon.push_back(voxel_to_world_coordinate_transform(f));
-
-						p0 = f;
-						found = true;
-						break;
-					}
-				}
-			}
+bool video_slicer::pick_slice(const vec3& ray_start, const vec3& ray_direction, size_t& index, vec3& hit_point, size_t ignored_index) const
+{
+	float t;
+	if (!get_picking_bvh().intersect(ray_start, ray_direction, std::numeric_limits<float>::max(), t, index, ignored_index))
+		return false;
+	hit_point = ray_start + t * ray_direction;
+	return true;
+}
+bool video_slicer::intersect_slice(size_t index, const vec3& ray_start, const vec3& ray_direction, vec3& hit_point) const
+{
+	if (index >= slice_origins.size())
+		return false;
+	float denominator = dot(slice_directions[index], ray_direction);
+	if (std::abs(denominator) < 1e-6f)
+		return false;
+	float t = -signed_distance_from_slice(index, ray_start) / denominator;
+	if (t < 0)
+		return false;
+	hit_point = ray_start + t * ray_direction;
+	box3 B(vec3(0.0f), vec3(get_dimensions()));
+	return B.inside(world_to_voxel_coordinate_transform(hit_point));
+}
 
-			if (found) break;
-		}
+bool video_slicer::intersect_slices(const vec3& ray_start, const vec3& ray_direction, float& hit_param, vec3& hit_normal, size_t& slice_index) const
+{
+	bool found = false;
+	// axis slices are intersected in voxel coordinates, which share the ray parameter with world coordinates
+	vec3 origin = world_to_voxel_coordinate_transform(ray_start);
+	vec3 direction = ray_direction * vec3(get_dimensions()) / V.get_extent();
+	box3 B(vec3(0.0f), vec3(get_dimensions()));
+	for (int i = 0; i < 3; ++i) {
+		if (!show_slices[i] || slice_indices[i] < 0 || std::abs(direction(i)) < 1e-12f)
+			continue;
+		float t = (slice_indices[i] + 0.5f - origin(i)) / direction(i);
+		if (t < 0 || (found && t >= hit_param))
+			continue;
+		vec3 p = origin + t * direction;
+		p(i) = slice_indices[i] + 0.5f;
+		if (!B.inside(p))
+			continue;
+		hit_param = t;
+		hit_normal = vec3(0.0f);
+		hit_normal(i) = direction(i) > 0 ? -1.0f : 1.0f;
+		slice_index = i;
+		found = true;
 	}
-
-	polygon.push_back(voxel_to_world_coordinate_transform(p[0]));
+	float t;
+	size_t s;
+	if (get_picking_bvh().intersect(ray_start, ray_direction, found ? hit_param : std::numeric_limits<float>::max(), t, s)) {
+		hit_param = t;
+		hit_normal = dot(slice_directions[s], ray_direction) > 0 ? -slice_directions[s] : slice_directions[s];
+		slice_index = 3 + s;
+		found = true;
+	}
+	return found;
 }
+
 float video_slicer::signed_distance_from_slice(size_t index, const vec3& p) const
 {
 	/************************************************************************************
@@ -2,13 +2,121 @@
 
 #include <cgv/render/drawable.h>
 #include <cgv/media/volume/volume.h>
+#include <cgv/type/standard_types.h>
 #include <cgv_gl/box_renderer.h>
-
-#define DEBUG
+#include "brick_cache.h"
+#include "frame_range_set.h"
+#include "pbo_uploader.h"
+#include "frame_prefetcher.h"
+#include "trace.h"
+#include "frame_timing.h"
+#include "slice_clipper.h"
+#include "slice_bvh.h"
+#include "label_volume.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
 
 class video_slicer : public cgv::render::drawable
 {
 	bool vol_tex_outofdate = false;
+	// background decoding of frame chunks in streaming ingest mode
+	std::thread ingest_thread;
+	std::atomic<bool> ingest_abort{ false };
+	std::atomic<bool> ingest_running{ false };
+	// protects the voxel data of V and the published frame range while the ingest thread runs
+	mutable std::mutex vol_mutex;
+	// frames of V that changed and still need to be uploaded to vol_tex
+	frame_range_set dirty_frames;
+	uint32_t nr_published_frames = 0;
+	// sliding window: window frame i is kept in slot (ring_offset + i) % frame_count of V and the volume textures
+	uint32_t window_offset = 0;
+	uint32_t ring_offset = 0;
+	// decoded frames [valid_begin, valid_end) of the window
+	uint32_t valid_begin = 0;
+	uint32_t valid_end = 0;
+	// counts window slides such that the ingest thread drops chunks decoded for a previous window, and the side the
+	// window moved to last, both protected by vol_mutex
+	uint32_t window_generation = 0;
+	bool ingest_backward = false;
+	// decoded part of window in texture coordinates, latched for rendering in init_frame
+	float shown_frames[2] = { 0.0f, 1.0f };
+	// slot of V that stores the given frame of the window
+	uint32_t get_frame_slot(uint32_t frame_index) const;
+	// add slots of window frames [frame_begin, frame_end) to given set
+	void add_slots(frame_range_set& slots, uint32_t frame_begin, uint32_t frame_end) const;
+	// mark slots of window frames [frame_begin, frame_end) for upload, expects vol_mutex to be locked
+	void add_dirty_frames(uint32_t frame_begin, uint32_t frame_end);
+	// playback: decoder pool for chunks ahead of the window and play head in absolute frames
+	frame_prefetcher prefetch;
+	double play_frame = 0;
+	std::chrono::steady_clock::time_point last_play_time;
+	// request chunks that the window will expose next when moving in given direction
+	void prefetch_chunks(int direction);
+	// move play head by elapsed time and slide window along during playback
+	void advance_playback();
+	// decode missing frames of the window at both ends of the decoded range, run by ingest_thread after the window moved
+	void ingest_window(std::string file_name, uint32_t chunk_size);
+	// decode frames [frame_begin, frame_end) of the window chunk by chunk, run by ingest_thread
+	void ingest_chunks(std::string file_name, uint32_t frame_offset, uint32_t frame_begin, uint32_t frame_end, uint32_t chunk_size);
+	// copy decoded chunk of window frames into their slots of V and mark them for upload; returns false without copying
+	// if the window slid since generation
+	bool publish_frames(const cgv::media::volume::volume& chunk, uint32_t frame_begin, uint32_t frame_end, uint32_t generation);
+	// upload frames [frame_begin, frame_end) of V into vol_tex
+	void upload_frames(cgv::render::context& ctx, uint32_t frame_begin, uint32_t frame_end);
+	// upload dirty frames of V into vol_tex without exceeding the per frame upload budget
+	void upload_dirty_frames(cgv::render::context& ctx);
+
+	// asynchronous upload path through pixel buffer objects filled by a worker thread
+	pbo_uploader pbo;
+	std::chrono::steady_clock::time_point rebuild_start;
+	// submit dirty frames to free pixel buffer objects and swap in the back texture once it is complete
+	void upload_dirty_frames_async(cgv::render::context& ctx);
+	// make upload target the front texture once all its frames arrived on the GPU
+	void swap_vol_tex(cgv::render::context& ctx);
+	// OpenGL pixel format of the components of V
+	unsigned get_gl_format() const;
+
+	// whether V holds luma and C chroma of the loaded video
+	bool chroma_subsampled = false;
+	// set formats of V and C for a volume of frame_width x frame_height x frame_count voxels decoded in format cf, and clear them
+	void allocate_frames(const cgv::data::component_format& cf);
+	// store decoded rgb frames at window frame frame_begin in V, converting them to luma and chroma if chroma_subsampled
+	void store_frames(const cgv::media::volume::volume& rgb_frames, uint32_t frame_begin, uint32_t nr_frames);
+	// convert decoded rgb frames to luma and 2x2 averaged chroma in the layout of V and C without accessing them
+	void convert_frames(const cgv::media::volume::volume& rgb_frames, uint32_t nr_frames, std::vector<uint8_t>& luma, std::vector<uint8_t>& chroma) const;
+	// copy frames in the layout of V and, if chroma_subsampled, of C to the ring slots of window frame frame_begin
+	void copy_frames(const uint8_t* frames, const uint8_t* chroma, uint32_t frame_begin, uint32_t nr_frames);
+	// frames of the ingest thread converted before vol_mutex is taken to copy them
+	std::vector<uint8_t> staging_luma, staging_chroma;
+
+	// label overlay: lower 8 bits of the labels of the window frames in the same ring of slots as vol_tex, colored through palette_tex
+	cgv::render::texture label_tex;
+	cgv::render::texture palette_tex;
+	bool label_tex_outofdate = false;
+	// slots that need a full upload of their labels
+	frame_range_set label_dirty_slots;
+	std::vector<uint8_t> label_buffer;
+	// upload changed label rectangles and dirty slots within the upload budget
+	void upload_labels(cgv::render::context& ctx);
+	void upload_label_region(cgv::render::context& ctx, uint32_t frame, uint32_t slot, const label_volume::region& R);
+	void create_palette(cgv::render::context& ctx);
+
+	// in out-of-core mode vol_tex is an atlas of brick slots and page_tex maps each brick to its slot (rgb) and residency (a)
+	cgv::render::texture page_tex;
+	std::vector<cgv::type::uint8_type> page_table;
+	bool page_table_outofdate = false;
+	// brick index stored in each atlas slot or size_t(-1) together with the frame the slot was last used in
+	std::vector<size_t> slot_bricks;
+	std::vector<uint64_t> slot_last_use;
+	std::unordered_map<size_t, uint32_t> brick_slots;
+	uint64_t brick_frame = 0;
+	std::vector<size_t> required_bricks;
+	// collect indices of bricks crossed by the visible slices
+	void collect_required_bricks(std::vector<size_t>& bricks) const;
+	// (re)create brick atlas if necessary and upload missing bricks of visible slices
+	void update_brick_atlas(cgv::render::context& ctx);
 protected:
 	cgv::render::box_render_style brs;
 
@@ -20,8 +128,65 @@ protected:
 	cgv::data::ComponentFormat pixel_format = cgv::data::CF_RGB;
 	std::string file_name;
 	cgv::media::volume::volume V;
+	// keep volume as planar YCbCr 4:2:0, where V holds luma and C holds chroma (Cb,Cr) at half resolution
+	bool ycbcr_420 = false;
+	cgv::media::volume::volume C;
+
+	// streaming ingest: return from load_video after the first chunk and decode the remaining frames in the background
+	bool streaming_ingest = false;
+	uint32_t ingest_chunk_size = 64;
+	// move loaded window along the video instead of reloading it when the frame offset changes
+	bool sliding_window = false;
+	// playback advances the time slice, negative frame rates play backwards
+	bool playing = false;
+	float playback_fps = 30;
+	// number of chunks decoded ahead of the window during playback
+	uint32_t prefetch_depth = 4;
+	uint32_t prefetch_queue_depth = 0;
+	uint32_t prefetch_hits = 0;
+	uint32_t prefetch_misses = 0;
+	// number of frames of V that are decoded and uploaded
+	uint32_t nr_loaded_frames = 0;
+	// maximum number of MB uploaded to vol_tex per frame, at least one frame is uploaded per frame
+	uint32_t upload_budget = 16;
+	// number of frames waiting for upload
+	uint32_t nr_dirty_frames = 0;
+	// upload through pixel buffer objects and render from previous texture until new texture is complete
+	bool async_upload = false;
+	// averaged latency from submit to GPU completion of one buffer in ms, MB currently in buffers and time from reload to swap in ms
+	float upload_latency = 0;
+	float upload_in_flight = 0;
+	float swap_latency = 0;
+	// bytes passed to texture uploads since construction, i.e. for measuring upload bandwidth
+	uint64_t nr_uploaded_bytes = 0;
 
-	cgv::render::texture vol_tex;
+	// out-of-core mode: frames are kept in a brick store next to the video file and only bricks crossed by slices are loaded
+	bool out_of_core = false;
+	uint32_t brick_width = 256;
+	uint32_t brick_height = 256;
+	uint32_t brick_depth = 64;
+	// host memory budget of brick cache in MB
+	uint32_t brick_cache_budget = 2048;
+	// number of brick slots along each axis of the atlas texture
+	uint32_t atlas_slots[3] = { 4, 4, 4 };
+	// maximum number of bricks uploaded to the atlas per frame
+	uint32_t max_brick_uploads = 8;
+	// host memory used by brick cache in MB and number of bricks resident in atlas
+	uint32_t brick_cache_usage = 0;
+	uint32_t nr_resident_bricks = 0;
+	brick_store bricks;
+	brick_cache brick_mem;
+
+	// per voxel class labels of the video in absolute frame indices, shown as overlay on the slices
+	label_volume labels;
+	bool show_labels = true;
+	float label_opacity = 0.5f;
+
+	// double buffered volume texture, rendering uses vol_tex[front_vol_tex] and uploads go to vol_tex[upload_vol_tex]
+	cgv::render::texture vol_tex[2];
+	cgv::render::texture chroma_tex[2];
+	unsigned front_vol_tex = 0;
+	unsigned upload_vol_tex = 0;
 	cgv::render::shader_program slice_prog;
 	cgv::render::attribute_array_manager aam;
 
@@ -40,12 +205,34 @@ protected:
 	vec3 world_to_voxel_coordinate_transform(const vec3& p_world) const;
 	vec3 voxel_to_world_coordinate_transform(const vec3& p_voxel) const;
 	vec3 voxel_to_world_coordinate_transform(const ivec3& i_voxel) const;
+	// dimensions of the video volume, which are also valid in out-of-core mode where V holds no voxels
+	ivec3 get_dimensions() const;
+	// absolute index of the first frame of the window
+	uint32_t get_window_offset() const;
+	// copy bytes of decoded absolute frame in V and, if chroma is given and chroma_subsampled, in C while vol_mutex is
+	// locked, such that callers convert them without blocking ingest and upload
+	bool copy_frame(uint32_t frame, std::vector<uint8_t>& data, std::vector<uint8_t>* chroma, unsigned& nr_components);
+	// copy luma of decoded absolute frame into luma, may be called from any thread
+	bool extract_luma(uint32_t frame, std::vector<uint8_t>& luma);
+	// copy rgb or, in case of chroma subsampling, YCbCr colors of decoded absolute frame into colors, may be called from any thread
+	bool extract_colors(uint32_t frame, std::vector<uint8_t>& colors);
+	// size of one frame of V in bytes
+	size_t get_frame_size() const;
+	// size of one frame of given volume in bytes
+	static size_t get_frame_size(const cgv::media::volume::volume& vol);
 	// general video reading for later use to extent video volume with further video frames in case of very long videos
 	bool read_video_file(const std::string& file_name, cgv::media::volume::volume& V, uint32_t frame_offset = 0, uint32_t frame_count = uint32_t(-1));
 	// read and place video volume
 	bool load_video(const std::string& file_name, uint32_t frame_offset = 0, uint32_t frame_count = uint32_t(-1));
+	// move window of loaded frames to new frame offset and decode only the frames that were not in the window before
+	bool slide_window(uint32_t new_frame_offset);
+	// abort and join ingest thread
+	void stop_ingest();
+	// check whether frames are still decoded in the background
+	bool is_ingesting() const;
 public:
 	video_slicer();
+	~video_slicer();
 
 	bool init(cgv::render::context& ctx);
 	void clear(cgv::render::context& ctx);
@@ -54,9 +241,61 @@ public:
 
 	bool create_slice(const vec3& origin, const vec3& direction, const rgba& color = rgba(0.f, 1.f, 1.f, 0.05f));
 	bool delete_slice(int index, size_t count = 1);
+	bool insert_slice(size_t index, const vec3& origin, const vec3& direction);
+	// move slice in place, which only reclips this slice and keeps the indices of all others
+	bool set_slice(size_t index, const vec3& origin, const vec3& direction);
 
 	size_t get_num_slices() const;
+	// center and extent of the volume box in world coordinates
+	const vec3& get_position() const { return position; }
+	vec3 get_extent() const { return V.get_extent(); }
+
+	// whether frames of the window are still decoded, wait for upload or have uploads in flight
+	bool is_uploading() const;
+	uint64_t get_nr_uploaded_bytes() const { return nr_uploaded_bytes; }
+
+	// intersect ray with plane of slice and return whether the hit point lies within the volume
+	bool intersect_slice(size_t index, const vec3& ray_start, const vec3& ray_direction, vec3& hit_point) const;
+	// find closest visible slice hit by ray, where the axis slices have indices 0 to 2 followed by the oblique slices
+	bool intersect_slices(const vec3& ray_start, const vec3& ray_direction, float& hit_param, vec3& hit_normal, size_t& slice_index) const;
+	// find closest oblique slice hit by ray other than ignored_index
+	bool pick_slice(const vec3& ray_start, const vec3& ray_direction, size_t& index, vec3& hit_point, size_t ignored_index = size_t(-1)) const;
+
+	// start or stop playback from the current time slice
+	void set_playback(bool play);
+	bool get_playback() const;
 private:
-	void construct_slice(size_t index, std::vector<vec3>& polygon) const;
+	// cached triangles of each slice, which are only reconstructed when the slice or the placement of the volume changes
+	struct slice_geometry
+	{
+		vec3 origin, direction;
+		slice_polygon polygon;
+		bool valid = false;
+	};
+	std::vector<vec3> axis_slice_triangles[3];
+	int cached_slice_indices[3] = { -2, -2, -2 };
+	std::vector<slice_geometry> oblique_slice_geometry;
+	// batch clipping of changed oblique slices, buffers are kept to avoid allocations per frame
+	slice_clipper clipper;
+	std::vector<size_t> changed_slices;
+	std::vector<slice_polygon> clipped_polygons;
+	vec3 cached_position, cached_extent;
+	ivec3 cached_dims;
+	// hierarchy over the clipped oblique slices for picking, which follows slice creation and deletion and is rebuilt
+	// on the next pick once the volume moved
+	mutable slice_bvh picking_bvh;
+	mutable vec3 bvh_position, bvh_extent;
+	mutable ivec3 bvh_dims;
+	mutable bool bvh_valid = false;
+	const slice_bvh& get_picking_bvh() const;
+	void clip_slice(size_t index, slice_polygon& polygon) const;
+	// vertex data of all slices as uploaded to the attribute arrays of aam
+	std::vector<vec3> slice_vertices;
+	std::vector<float> slice_opacities;
+	// reconstruct changed slices and return whether vertex data changed
+	bool update_slice_geometry();
+	void construct_axis_slice(int i, std::vector<vec3>& triangles) const;
+	// append triangle fan of slice polygon to slice_vertices
+	void append_slice_triangles(size_t index, const slice_polygon& polygon);
 	float signed_distance_from_slice(size_t index, const vec3& p) const;
 };
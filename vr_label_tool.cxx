@@ -1,383 +1,635 @@
-#include <cgv/base/group.h>
-#include <cgv/render/drawable.h>
-#include <cgv/gui/provider.h>
-
-#include <cg_nui/focusable.h>
-#include <cg_nui/transforming.h>
-#include <plugins/vr_lab/vr_tool.h>
-
-#include <cgv/math/ftransform.h>
-#include <cgv_gl/surfel_renderer.h>
-
-#include "video_labeler.h"
-#include "pressable.h"
-
-class vr_label_tool : 
-	public cgv::base::group,
-	public cgv::render::drawable,
-	public cgv::nui::focusable,
-	public cgv::nui::transforming,
-	public cgv::gui::provider,
-	public vr::vr_tool
-{
-	/// label index to show statistics
-	uint32_t li_stats; 
-	/// background color of statistics label
-	rgba stats_bgclr;
-	/// labels to show help on controllers
-	uint32_t li_help[2];
-	/// label for play button
-	uint32_t li_play = -1;
-	///
-	bool playback = false;
-
-	cgv::render::surfel_render_style surf_rs;
-public:
-	enum class tool_enum {
-		none,
-		slice
-	};
-
-	std::string get_type_name() const
-	{
-		return "vr_label_tool";
-	}
-	bool self_reflect(cgv::reflect::reflection_handler& rh)
-	{
-		return false;
-	}
-	/// transform point with pose to lab coordinate system 
-	vec3 compute_lab_draw_position(const float* pose, const vec3& p)
-	{
-		return mat34(3, 4, pose) * vec4(p, 1.0f);
-	}
-	video_labeler_ptr labeler;
-	std::vector<pressable_ptr> buttons;
+#include "vr_label_tool.h"
 
-protected:
-	// active tool 
-	tool_enum tool = tool_enum::slice;
-
-	// previous inverse model transform
-	// if this changes (e.g. the table is rotated), the quaternion for rotating control direction must be recalculated
-	mat4 prev_inverse_model_transform;
-	quat control_down_rotation;
-
-	// previous position and down direction of the right controller
-	vec3 prev_control_origin;
-	vec3 prev_control_down;
+std::string vr_label_tool::get_type_name() const
+{
+	return "vr_label_tool";
+}
 
-	// slice
-	// index of temporary slice
-	int temp_slice_idx = -1;
-	size_t selected_slice_idx = SIZE_MAX;
+bool vr_label_tool::self_reflect(cgv::reflect::reflection_handler& rh)
+{
+	return
+		rh.reflect_member("stats_refresh_interval", stats_refresh_interval) &&
+		rh.reflect_member("record_timing", record_timing) &&
+		rh.reflect_member("timing_window", timing_window) &&
+		rh.reflect_member("timing_file_name", timing_file_name) &&
+		rh.reflect_member("slice_position_dead_band", slice_position_dead_band) &&
+		rh.reflect_member("slice_angle_dead_band", slice_angle_dead_band) &&
+		rh.reflect_member("slice_update_rate", slice_update_rate) &&
+		rh.reflect_member("slice_filter", slice_filter.enabled) &&
+		rh.reflect_member("slice_filter_min_cutoff", slice_filter.min_cutoff) &&
+		rh.reflect_member("slice_filter_beta", slice_filter.beta) &&
+		rh.reflect_member("slice_filter_derivative_cutoff", slice_filter.derivative_cutoff) &&
+		rh.reflect_member("slice_prediction_time", slice_filter.prediction_time) &&
+		rh.reflect_member("replay_real_time", replay_real_time) &&
+		rh.reflect_member("session_file_name", session_file_name);
+}
+
+vr_label_tool::vec3 vr_label_tool::compute_lab_draw_position(const float* pose, const vec3& p)
+{
+	return mat34(3, 4, pose) * vec4(p, 1.0f);
+}
 
-	// distance from front and bottom slices to the controller
-	float front_slice_distance = 0.075f;
-	float bottom_slice_distance = 0.085f;
+vr_label_tool::vr_label_tool() : cgv::base::group("vr_label_tool")
+{
+	li_help[0] = li_help[1] = -1;
+	li_stats = -1;
+	stats_bgclr = rgba(0.8f, 0.6f, 0.0f, 0.6f);
+	buttons.push_back(new pressable("play", vec3(0.6f, 0.015f, 0), rgb(0.6f, 0.3f, 0.1f), vec3(0.15f,0.03f,0.15f), 0.015f));
+	connect_copy(buttons.back()->pressed, cgv::signal::rebind(this, &vr_label_tool::on_pressed, cgv::signal::_c<unsigned>(0)));
+	append_child(buttons.back());
+	labeler = video_labeler_ptr(new video_labeler("labeler", rgb(0.5, 0.5f, 0.3f)));
+	append_child(labeler);
+	register_object(labeler);
+
+	surf_rs.illumination_mode = cgv::render::IlluminationMode::IM_OFF;
+	surf_rs.culling_mode = cgv::render::CullingMode::CM_OFF;
+	surf_rs.measure_point_size_in_pixel = false;
+	surf_rs.blend_points = true;
+	surf_rs.point_size = 1.8f;
+	surf_rs.percentual_halo_width = 5.0f;
+	surf_rs.surface_color = rgba(0, 0.8f, 1.0f);
+	surf_rs.material.set_transparency(0.75f);
+	surf_rs.halo_color = rgba(0, 0.8f, 1.0f, 0.8f);
+}
+
+void vr_label_tool::on_pressed(unsigned i)
+{
+	if (i == 0) {
+		playback = !playback;
+		on_set(&playback);
+	}
+}
 
-public:
-	vr_label_tool() : cgv::base::group("vr_label_tool")
-	{
-		li_help[0] = li_help[1] = -1;
-		li_stats = -1;
-		stats_bgclr = rgba(0.8f, 0.6f, 0.0f, 0.6f);
-		buttons.push_back(new pressable("play", vec3(0.6f, 0.015f, 0), rgb(0.6f, 0.3f, 0.1f), vec3(0.15f,0.03f,0.15f), 0.015f));
-		connect_copy(buttons.back()->pressed, cgv::signal::rebind(this, &vr_label_tool::on_pressed, cgv::signal::_c<unsigned>(0)));
-		append_child(buttons.back());
-		labeler = video_labeler_ptr(new video_labeler("labeler", rgb(0.5, 0.5f, 0.3f)));
-		append_child(labeler);
-		register_object(labeler);
-
-		surf_rs.illumination_mode = cgv::render::IlluminationMode::IM_OFF;
-		surf_rs.culling_mode = cgv::render::CullingMode::CM_OFF;
-		surf_rs.measure_point_size_in_pixel = false;
-		surf_rs.blend_points = true;
-		surf_rs.point_size = 1.8f;
-		surf_rs.percentual_halo_width = 5.0f;
-		surf_rs.surface_color = rgba(0, 0.8f, 1.0f);
-		surf_rs.material.set_transparency(0.75f);
-		surf_rs.halo_color = rgba(0, 0.8f, 1.0f, 0.8f);
+void vr_label_tool::on_set(void* member_ptr)
+{
+	if (member_ptr == &playback) {
+		if (labeler->get_playback() != playback)
+			labeler->set_playback(playback);
+		if (li_play != -1) {
+			vr::vr_scene* scene_ptr = get_scene_ptr();
+			if (scene_ptr)
+				scene_ptr->update_label_text(li_play, playback ? "stop" : "play");
+		}
 	}
-	void on_pressed(unsigned i)
-	{
-		if (i == 0) {
-			playback = !playback;
-			on_set(&playback);
+	if (member_ptr == &record_timing) {
+		frame_timing::enabled = record_timing;
+		// show label statistics without timings again
+		shown_stats_version = uint32_t(-1);
+	}
+	if (member_ptr == &record_session) {
+		if (record_session) {
+			if (replay_session) {
+				replay_session = false;
+				on_set(&replay_session);
+			}
+			session.clear();
+			record_start = std::chrono::steady_clock::now();
 		}
+		else if (!session.samples.empty() && !session.write(session_file_name))
+			std::cerr << "could not write session to " << session_file_name << std::endl;
 	}
-	void on_set(void* member_ptr)
-	{
-		if (member_ptr == &playback) {
-			if (li_play != -1) {
-				vr::vr_scene* scene_ptr = get_scene_ptr();
-				if (scene_ptr)
-					scene_ptr->update_label_text(li_play, playback ? "stop" : "play");
+	if (member_ptr == &replay_session) {
+		if (replay_session) {
+			if (record_session) {
+				record_session = false;
+				on_set(&record_session);
+			}
+			if (session.read(session_file_name) && !session.samples.empty()) {
+				replay_state = {};
+				replayer.start(session, replay_real_time);
+			}
+			else {
+				std::cerr << "could not read session from " << session_file_name << std::endl;
+				replay_session = false;
 			}
 		}
-		if (member_ptr == &stats_bgclr && li_stats != -1)
-			get_scene_ptr()->update_label_background_color(li_stats, stats_bgclr);
+		else
+			replayer.stop();
+	}
+	// restart smoothing from the current pose
+	if (member_ptr == &slice_filter.enabled)
+		slice_filter.reset();
+	if (member_ptr == &stats_bgclr && li_stats != -1)
+		get_scene_ptr()->update_label_background_color(li_stats, stats_bgclr);
+
+	update_member(member_ptr);
+	post_redraw();
+}
 
-		update_member(member_ptr);
+void vr_label_tool::update_stats_label(vr::vr_scene* scene_ptr)
+{
+	// frame timings change every frame
+	bool timing = frame_timing::enabled.load();
+	if (li_stats == -1 || (!timing && labeler->get_label_stats_version() == shown_stats_version))
+		return;
+	auto now = std::chrono::steady_clock::now();
+	if (std::chrono::duration<float>(now - last_stats_update).count() < stats_refresh_interval) {
+		// come back for the pending update
 		post_redraw();
+		return;
 	}
-	bool init(cgv::render::context& ctx)
-	{
-		cgv::render::ref_surfel_renderer(ctx, 1);
-		return true;
+	last_stats_update = now;
+	shown_stats_version = labeler->get_label_stats_version();
+	std::string text = labeler->get_label_stats_text();
+	if (timing)
+		text += "\n\n" + frame_timing::get_statistics_text(timing_window);
+	scene_ptr->update_label_text(li_stats, text);
+	scene_ptr->show_label(li_stats);
+}
+
+void vr_label_tool::write_timing(bool chrome_trace)
+{
+	std::string file_name = timing_file_name + (chrome_trace ? ".json" : ".csv");
+	bool written = chrome_trace ? frame_timing::write_chrome_trace(file_name) : frame_timing::write_csv(file_name);
+	if (!written)
+		std::cerr << "could not write frame timing to " << file_name << std::endl;
+}
+
+void vr_label_tool::clear_timing()
+{
+	frame_timing::clear();
+}
+
+const vr::vr_kit_state* vr_label_tool::get_vr_state()
+{
+	if (replayer.is_running())
+		return &replay_state;
+	vr_view_interactor* vr_view_ptr = get_view_ptr();
+	if (!vr_view_ptr)
+		return nullptr;
+	return vr_view_ptr->get_current_vr_state();
+}
+
+void vr_label_tool::replay_frame()
+{
+	std::vector<pose_trace::key_event> due_events;
+	if (!replayer.advance(replay_state, due_events)) {
+		replay_session = false;
+		on_set(&replay_session);
+		return;
 	}
-	void init_frame(cgv::render::context& ctx)
-	{		
-		vr::vr_scene* scene_ptr = get_scene_ptr();
-		if (!scene_ptr)
-			return;
-		// if not done before, create labels
-		if (li_help[0] == -1) {
-			li_play = scene_ptr->add_label("play", rgba(0, 0, 0, 0));
-			scene_ptr->fix_label_size(li_play);
-			scene_ptr->place_label(li_play, vec3(0.6f, 0.0301f, 0), quat(vec3(1,0,0), -1.57079632679489661f), coordinate_system::table);
-
-			li_stats = scene_ptr->add_label(
-				"drawing index: 000000\n"
-				"nr vertices:   000000\n"
-				"nr edges:      000000", stats_bgclr);
-			scene_ptr->fix_label_size(li_stats);
-			scene_ptr->place_label(li_stats, vec3(0.0f, 0.01f, 0.0f), quat(vec3(1, 0, 0), -1.5f), coordinate_system::table);
-			scene_ptr->hide_label(li_stats);
-			for (int ci = 0; ci < 2; ++ci) {
-				li_help[ci] = scene_ptr->add_label("DPAD_Right .. next/new drawing\nDPAD_Left  .. prev drawing\nDPAD_Down  .. save drawing\nDPAD_Up .. toggle draw mode\nTPAD_Touch&Up/Dn .. change radius\nTPAD_Touch&Move .. change color\ncolorize (0.000)\nRGB(0.00,0.00,0.00)\nHLS(0.00,0.00,0.00)",
-					rgba(ci == 0 ? 0.8f : 0.4f, 0.4f, ci == 1 ? 0.8f : 0.4f, 0.6f));
-				scene_ptr->fix_label_size(li_help[ci]);
-				scene_ptr->place_label(li_help[ci], vec3(ci == 1 ? -0.05f : 0.05f, 0.0f, 0.0f), quat(vec3(1, 0, 0), -1.5f),
-					ci == 0 ? coordinate_system::left_controller : coordinate_system::right_controller, 
-					ci == 1 ? label_alignment::right : label_alignment::left, 0.2f);
-				scene_ptr->hide_label(li_help[ci]);
-			}
-		}
-		// always update visibility of visibility changing labels
+	for (const auto& ke : due_events)
+		handle_controller_key(ke.controller_index, ke.key, cgv::gui::KeyAction(ke.action));
+	// replay does not wait for tracking events
+	post_redraw();
+}
+
+double vr_label_tool::get_slice_time() const
+{
+	if (replayer.is_running())
+		return replayer.get_time();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double vr_label_tool::get_record_time() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - record_start).count();
+}
+
+bool vr_label_tool::init(cgv::render::context& ctx)
+{
+	cgv::render::ref_surfel_renderer(ctx, 1);
+	return true;
+}
+
+void vr_label_tool::init_frame(cgv::render::context& ctx)
+{		
+	frame_timing::begin_frame();
+	frame_timing::collect_gpu();
+	if (replayer.is_running())
+		replay_frame();
+	else if (record_session) {
 		vr_view_interactor* vr_view_ptr = get_view_ptr();
-		if (!vr_view_ptr)
-			return;
-		const vr::vr_kit_state* state_ptr = vr_view_ptr->get_current_vr_state();
-		if (!state_ptr)
-			return;
-		vec3 view_dir = -reinterpret_cast<const vec3&>(state_ptr->hmd.pose[6]);
-		vec3 view_pos = reinterpret_cast<const vec3&>(state_ptr->hmd.pose[9]);
+		const vr::vr_kit_state* state_ptr = vr_view_ptr ? vr_view_ptr->get_current_vr_state() : nullptr;
+		if (state_ptr)
+			session.append_state(get_record_time(), *state_ptr);
+	}
+	// labeler stops playback at the end of the video
+	if (playback != labeler->get_playback()) {
+		playback = labeler->get_playback();
+		on_set(&playback);
+	}
+	vr::vr_scene* scene_ptr = get_scene_ptr();
+	if (!scene_ptr)
+		return;
+	// if not done before, create labels
+	if (li_help[0] == -1) {
+		li_play = scene_ptr->add_label("play", rgba(0, 0, 0, 0));
+		scene_ptr->fix_label_size(li_play);
+		scene_ptr->place_label(li_play, vec3(0.6f, 0.0301f, 0), quat(vec3(1,0,0), -1.57079632679489661f), coordinate_system::table);
+
+		// initial text reserves the size of the statistics label
+		li_stats = scene_ptr->add_label(
+			"label:         00000\n"
+			"voxels:        0000000000\n"
+			"frames:        000000 .. 000000\n"
+			"frame area:    00000000 (frame 000000)\n"
+			"mean area:     00000000.0\n\n"
+			"ms p50/p95/p99   cpu              gpu\n"
+			"slicer_init_frame 00.00/00.00/00.00  00.00/00.00/00.00\n"
+			"slicer_draw       00.00/00.00/00.00  00.00/00.00/00.00\n"
+			"compute_slice     00.00/00.00/00.00\n"
+			"pressable_draw    00.00/00.00/00.00  00.00/00.00/00.00\n"
+			"texture_upload    00.00/00.00/00.00  00.00/00.00/00.00\n"
+			"slice_geometry    00.00/00.00/00.00\n"
+			"frame             00.00/00.00/00.00", stats_bgclr);
+		scene_ptr->fix_label_size(li_stats);
+		scene_ptr->place_label(li_stats, vec3(0.0f, 0.01f, 0.0f), quat(vec3(1, 0, 0), -1.5f), coordinate_system::table);
+		scene_ptr->hide_label(li_stats);
+		shown_stats_version = uint32_t(-1);
 		for (int ci = 0; ci < 2; ++ci) {
-			vec3 controller_pos = reinterpret_cast<const vec3&>(state_ptr->controller[ci].pose[9]);
-			float controller_depth = dot(view_dir, controller_pos - view_pos);
-			float controller_dist = (view_pos + controller_depth * view_dir - controller_pos).length();
-			if (view_dir.y() < -0.25f && controller_depth / controller_dist > 1.0f)
-				scene_ptr->show_label(li_help[ci]);
-			else
-				scene_ptr->hide_label(li_help[ci]);
+			li_help[ci] = scene_ptr->add_label("DPAD_Right .. next/new drawing\nDPAD_Left  .. prev drawing\nDPAD_Down  .. save drawing\nDPAD_Up .. toggle draw mode\nTPAD_Touch&Up/Dn .. change radius\nTPAD_Touch&Move .. change color\ncolorize (0.000)\nRGB(0.00,0.00,0.00)\nHLS(0.00,0.00,0.00)",
+				rgba(ci == 0 ? 0.8f : 0.4f, 0.4f, ci == 1 ? 0.8f : 0.4f, 0.6f));
+			scene_ptr->fix_label_size(li_help[ci]);
+			scene_ptr->place_label(li_help[ci], vec3(ci == 1 ? -0.05f : 0.05f, 0.0f, 0.0f), quat(vec3(1, 0, 0), -1.5f),
+				ci == 0 ? coordinate_system::left_controller : coordinate_system::right_controller, 
+				ci == 1 ? label_alignment::right : label_alignment::left, 0.2f);
+			scene_ptr->hide_label(li_help[ci]);
 		}
 	}
-	void clear(cgv::render::context& ctx)
-	{
-		cgv::render::ref_surfel_renderer(ctx, -1);
+	update_stats_label(scene_ptr);
+	// the held slice and the brush follow the controllers once per frame, whereas draw is called once per eye
+	mat4 model_transform(3, 4, &scene_ptr->get_coordsystem(coordinate_system::table)(0, 0));
+	set_model_transform(model_transform);
+	if (tool == tool_enum::slice) {
+		compute_slice();
+		compute_brush();
 	}
-	void draw(cgv::render::context& ctx)
-	{
-		mat4 model_transform(3, 4, &get_scene_ptr()->get_coordsystem(coordinate_system::table)(0, 0));
-		set_model_transform(model_transform);
+	// always update visibility of visibility changing labels
+	const vr::vr_kit_state* state_ptr = get_vr_state();
+	if (!state_ptr)
+		return;
+	vec3 view_dir = -reinterpret_cast<const vec3&>(state_ptr->hmd.pose[6]);
+	vec3 view_pos = reinterpret_cast<const vec3&>(state_ptr->hmd.pose[9]);
+	for (int ci = 0; ci < 2; ++ci) {
+		vec3 controller_pos = reinterpret_cast<const vec3&>(state_ptr->controller[ci].pose[9]);
+		float controller_depth = dot(view_dir, controller_pos - view_pos);
+		float controller_dist = (view_pos + controller_depth * view_dir - controller_pos).length();
+		if (view_dir.y() < -0.25f && controller_depth / controller_dist > 1.0f)
+			scene_ptr->show_label(li_help[ci]);
+		else
+			scene_ptr->hide_label(li_help[ci]);
+	}
+}
 
-		ctx.push_modelview_matrix();
-		ctx.mul_modelview_matrix(model_transform);
+void vr_label_tool::clear(cgv::render::context& ctx)
+{
+	frame_timing::clear_gpu();
+	cgv::render::ref_surfel_renderer(ctx, -1);
+}
 
-		if (tool == tool_enum::slice)
-			compute_slice();
-	}
-	void finish_draw(cgv::render::context& ctx)
-	{
-		ctx.pop_modelview_matrix();
-	}
-	//void finish_frame(cgv::render::context& ctx)
-	//{
-	//	// draw infinite clipping plane (as a disc) only when outside of wireframe box
-	//	if (tool == tool_enum::slice && temp_slice_idx == -1 && get_scene_ptr()->is_coordsystem_valid(coordinate_system::right_controller))
-	//	{
-	//		ctx.push_modelview_matrix();
-	//		ctx.mul_modelview_matrix(cgv::math::pose4(get_scene_ptr()->get_coordsystem(coordinate_system::right_controller)));
-	//		glEnable(GL_BLEND);
-	//		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	//		draw_circle(ctx, vec3(0.0f, -0.05f, 0.0f), vec3(0, -1, 0));
-	//		glDisable(GL_BLEND);
-	//		ctx.pop_modelview_matrix();
-	//	}
-	//}
-	void draw_circle(cgv::render::context& ctx, const vec3& position, const vec3& normal)
-	{
-		auto& sr = cgv::render::ref_surfel_renderer(ctx);
-		sr.set_reference_point_size(0.5f);
-		sr.set_render_style(surf_rs);
-		sr.set_position(ctx, position);
-		sr.set_normal(ctx, normal);
-		sr.render(ctx, 0, 1);
-	}
-	void stream_help(std::ostream& os)
-	{
-		os << "vr_label_tool: no interaction" << std::endl;
-	}
+void vr_label_tool::draw(cgv::render::context& ctx)
+{
+	mat4 model_transform(3, 4, &get_scene_ptr()->get_coordsystem(coordinate_system::table)(0, 0));
+	set_model_transform(model_transform);
 
-	bool focus_change(cgv::nui::focus_change_action action, cgv::nui::refocus_action rfa, const cgv::nui::focus_demand& demand, const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info)
-	{
-		return false;
+	ctx.push_modelview_matrix();
+	ctx.mul_modelview_matrix(model_transform);
+
+	if (tool == tool_enum::slice) {
+		if (brush_hit)
+			draw_brush(ctx, brush_position, prev_control_down);
 	}
-	bool handle(const cgv::gui::event& e)
-	{
-		// check if vr event flag is not set and don't process events in this case
-		if ((e.get_flags() & cgv::gui::EF_VR) != 0) {
-			switch (e.get_kind()) {
-			case cgv::gui::EID_KEY:
-			{
-				//cgv::gui::vr_key_event& vrke = static_cast<cgv::gui::vr_key_event&>(e);
-				//if (vrke.get_controller_index() == 1) { // only right controller
-				//	if (vrke.get_action() != cgv::gui::KA_RELEASE) {
-				//		switch (vrke.get_key()) {
-				//		case vr::VR_DPAD_LEFT:
-				//			switch (tool) {
-				//			case tool_enum::slice:
-				//				set_slice(); // put current slice permanently
-				//				break;
-				//			default:
-				//				break;
-				//			}
-				//			return true;
-				//		case vr::VR_DPAD_RIGHT:
-				//			switch (tool) {
-				//			case tool_enum::slice:
-				//				release_slice(); // release slice disc
-				//				tool = tool_enum::none;
-				//				break;
-				//			default:
-				//				delete_slice();
-				//				tool = tool_enum::none;
-				//				break;
-				//			}
-				//			return true;
-				//		}
-				//	}
-				//}
-				//break;
-			}
-			return false;
-			}
-		}
+}
 
+void vr_label_tool::finish_draw(cgv::render::context& ctx)
+{
+	ctx.pop_modelview_matrix();
+}
+
+//void finish_frame(cgv::render::context& ctx)
+//{
+//	// draw infinite clipping plane (as a disc) only when outside of wireframe box
+//	if (tool == tool_enum::slice && temp_slice_idx == -1 && get_scene_ptr()->is_coordsystem_valid(coordinate_system::right_controller))
+//	{
+//		ctx.push_modelview_matrix();
+//		ctx.mul_modelview_matrix(cgv::math::pose4(get_scene_ptr()->get_coordsystem(coordinate_system::right_controller)));
+//		glEnable(GL_BLEND);
+//		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+//		draw_circle(ctx, vec3(0.0f, -0.05f, 0.0f), vec3(0, -1, 0));
+//		glDisable(GL_BLEND);
+//		ctx.pop_modelview_matrix();
+//	}
+//}
+
+void vr_label_tool::draw_circle(cgv::render::context& ctx, const vec3& position, const vec3& normal)
+{
+	auto& sr = cgv::render::ref_surfel_renderer(ctx);
+	sr.set_reference_point_size(0.5f);
+	sr.set_render_style(surf_rs);
+	sr.set_position(ctx, position);
+	sr.set_normal(ctx, normal);
+	sr.render(ctx, 0, 1);
+}
+
+void vr_label_tool::draw_brush(cgv::render::context& ctx, const vec3& position, const vec3& normal)
+{
+	auto& sr = cgv::render::ref_surfel_renderer(ctx);
+	// scale surfel to brush diameter
+	sr.set_reference_point_size(2.0f * labeler->get_brush_radius() / surf_rs.point_size);
+	sr.set_render_style(surf_rs);
+	sr.set_position(ctx, position);
+	sr.set_normal(ctx, normal);
+	sr.render(ctx, 0, 1);
+}
+
+void vr_label_tool::stream_help(std::ostream& os)
+{
+	os << "vr_label_tool: left trigger paints current label on the slice held by the right controller" << std::endl;
+	os << "  left dpad: left/right .. undo/redo, up .. select pointed slice, down .. delete selected slice" << std::endl;
+	os << "  right dpad: left .. store held slice" << std::endl;
+}
+
+bool vr_label_tool::focus_change(cgv::nui::focus_change_action action, cgv::nui::refocus_action rfa, const cgv::nui::focus_demand& demand, const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info)
+{
+	return false;
+}
+
+bool vr_label_tool::handle_controller_key(int controller_index, unsigned short key, cgv::gui::KeyAction action)
+{
+	if (!labeler || action == cgv::gui::KA_RELEASE)
 		return false;
+	// store the slice held by the right controller
+	if (controller_index == 1) {
+		if (key != vr::VR_DPAD_LEFT || temp_slice_idx == -1)
+			return false;
+		remove_temp_slice();
+		labeler->create_slice(prev_control_origin, prev_control_down);
+		return true;
 	}
-	bool handle(const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info, cgv::nui::focus_request& request)
-	{
+	if (controller_index != 0)
 		return false;
-	}
-	void create_gui()
-	{
-		add_decorator("vr_label_tool", "heading");
-		add_member_control(this, "play", playback, "toggle");
-		add_member_control(this, "stats_bgclr", stats_bgclr);
-		if (begin_tree_node("labeler", labeler, true)) {
-			align("\a");
-			inline_object_gui(labeler);
-			align("\b");
-			end_tree_node(labeler);
+	switch (key) {
+	case vr::VR_DPAD_LEFT:
+		remove_temp_slice();
+		labeler->undo();
+		return true;
+	case vr::VR_DPAD_RIGHT:
+		remove_temp_slice();
+		labeler->redo();
+		return true;
+	case vr::VR_DPAD_UP:
+		select_slice();
+		return true;
+	case vr::VR_DPAD_DOWN:
+		// delete selected stored slice
+		if (selected_slice_idx != SIZE_MAX) {
+			remove_temp_slice();
+			labeler->delete_slice(int(selected_slice_idx));
+			selected_slice_idx = SIZE_MAX;
 		}
-		if (begin_tree_node("buttons", buttons)) {
-			align("\a");
-			for (auto op : buttons)
-				if (begin_tree_node(op->get_name(), *op)) {
-					align("\a");
-					inline_object_gui(op);
-					align("\b");
-					end_tree_node(*op);
-				}
-			align("\b");
-			end_tree_node(buttons);
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool vr_label_tool::handle(const cgv::gui::event& e)
+{
+	// check if vr event flag is not set and don't process events in this case
+	if ((e.get_flags() & cgv::gui::EF_VR) != 0) {
+		switch (e.get_kind()) {
+		case cgv::gui::EID_KEY:
+		{
+			const cgv::gui::vr_key_event& vrke = static_cast<const cgv::gui::vr_key_event&>(e);
+			// live keys would interfere with the replayed session
+			if (replayer.is_running())
+				return true;
+			if (record_session)
+				session.append_key_event(get_record_time(), vrke.get_controller_index(), vrke.get_key(), vrke.get_action());
+			if (handle_controller_key(vrke.get_controller_index(), vrke.get_key(), vrke.get_action()))
+				return true;
+			//cgv::gui::vr_key_event& vrke = static_cast<cgv::gui::vr_key_event&>(e);
+			//if (vrke.get_controller_index() == 1) { // only right controller
+			//	if (vrke.get_action() != cgv::gui::KA_RELEASE) {
+			//		switch (vrke.get_key()) {
+			//		case vr::VR_DPAD_LEFT:
+			//			switch (tool) {
+			//			case tool_enum::slice:
+			//				set_slice(); // put current slice permanently
+			//				break;
+			//			default:
+			//				break;
+			//			}
+			//			return true;
+			//		case vr::VR_DPAD_RIGHT:
+			//			switch (tool) {
+			//			case tool_enum::slice:
+			//				release_slice(); // release slice disc
+			//				tool = tool_enum::none;
+			//				break;
+			//			default:
+			//				delete_slice();
+			//				tool = tool_enum::none;
+			//				break;
+			//			}
+			//			return true;
+			//		}
+			//	}
+			//}
+			//break;
 		}
-		if (begin_tree_node("surfel rendering", surf_rs, false)) {
-			align("\a");
-			add_gui("surfel_style", surf_rs);
-			align("\b");
-			end_tree_node(surf_rs);
+		return false;
 		}
 	}
 
-	void compute_slice()
-	{
-		bool control_changed = false;
+	return false;
+}
 
-		vr_view_interactor* vr_view_ptr = get_view_ptr();
-		if (!vr_view_ptr)
-			return;
-		const vr::vr_kit_state* state_ptr = vr_view_ptr->get_current_vr_state();
-		if (!state_ptr)
-			return;
+bool vr_label_tool::handle(const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info, cgv::nui::focus_request& request)
+{
+	return false;
+}
 
-		vec3 down = -reinterpret_cast<const vec3&>(state_ptr->controller[1].pose[3]);
-		vec3 origin = reinterpret_cast<const vec3&>(state_ptr->controller[1].pose[9]);
-		origin += bottom_slice_distance * down;
+void vr_label_tool::create_gui()
+{
+	add_decorator("vr_label_tool", "heading");
+	add_member_control(this, "play", playback, "toggle");
+	add_member_control(this, "stats_bgclr", stats_bgclr);
+	add_member_control(this, "stats_refresh_interval", stats_refresh_interval, "value_slider", "min=0;max=2;ticks=true");
+	if (begin_tree_node("temporary slice", slice_update_rate)) {
+		align("\a");
+		add_member_control(this, "position dead band", slice_position_dead_band, "value_slider", "min=0;max=0.02;step=0.0001;log=true;ticks=true");
+		add_member_control(this, "angle dead band (deg)", slice_angle_dead_band, "value_slider", "min=0;max=5;step=0.01;log=true;ticks=true");
+		add_member_control(this, "update rate (Hz)", slice_update_rate, "value_slider", "min=0;max=120;ticks=true");
+		add_member_control(this, "filter", slice_filter.enabled, "check");
+		add_member_control(this, "min cutoff (Hz)", slice_filter.min_cutoff, "value_slider", "min=0.01;max=10;log=true;ticks=true");
+		add_member_control(this, "beta", slice_filter.beta, "value_slider", "min=0;max=200;log=true;ticks=true");
+		add_member_control(this, "derivative cutoff (Hz)", slice_filter.derivative_cutoff, "value_slider", "min=0.01;max=10;log=true;ticks=true");
+		add_member_control(this, "prediction (s)", slice_filter.prediction_time, "value_slider", "min=0;max=0.1;step=0.001;ticks=true");
+		align("\b");
+		end_tree_node(slice_update_rate);
+	}
+	if (begin_tree_node("frame timing", record_timing)) {
+		align("\a");
+		add_member_control(this, "record", record_timing, "check");
+		add_member_control(this, "window (frames)", timing_window, "value_slider", "min=10;max=2000;log=true;ticks=true");
+		add_member_control(this, "file name", timing_file_name);
+		connect_copy(add_button("write csv")->click, cgv::signal::rebind(this, &vr_label_tool::write_timing, cgv::signal::_c<bool>(false)));
+		connect_copy(add_button("write chrome trace")->click, cgv::signal::rebind(this, &vr_label_tool::write_timing, cgv::signal::_c<bool>(true)));
+		connect_copy(add_button("clear")->click, cgv::signal::rebind(this, &vr_label_tool::clear_timing));
+		align("\b");
+		end_tree_node(record_timing);
+	}
+	if (begin_tree_node("session", session_file_name)) {
+		align("\a");
+		add_member_control(this, "record", record_session, "toggle");
+		add_member_control(this, "replay", replay_session, "toggle");
+		add_member_control(this, "replay in real time", replay_real_time, "check");
+		add_member_control(this, "file name", session_file_name);
+		add_decorator("replay drives slice, brush and keys only, grabbing and pointing stay live", "heading", "level=4");
+		align("\b");
+		end_tree_node(session_file_name);
+	}
+	if (begin_tree_node("labeler", labeler, true)) {
+		align("\a");
+		inline_object_gui(labeler);
+		align("\b");
+		end_tree_node(labeler);
+	}
+	if (begin_tree_node("buttons", buttons)) {
+		align("\a");
+		for (auto op : buttons)
+			if (begin_tree_node(op->get_name(), *op)) {
+				align("\a");
+				inline_object_gui(op);
+				align("\b");
+				end_tree_node(*op);
+			}
+		align("\b");
+		end_tree_node(buttons);
+	}
+	if (begin_tree_node("surfel rendering", surf_rs, false)) {
+		align("\a");
+		add_gui("surfel_style", surf_rs);
+		align("\b");
+		end_tree_node(surf_rs);
+	}
+}
 
-#ifdef DEBUG
-		std::cout << "\norig down\t" << down;
-		std::cout << "\norig origin\t" << origin << std::endl;
-#endif
+void vr_label_tool::compute_slice()
+{
+	const vr::vr_kit_state* state_ptr = get_vr_state();
+	if (!state_ptr)
+		return;
+	update_slice(state_ptr->controller[1].pose, get_slice_time());
+}
 
-		if (prev_inverse_model_transform != get_inverse_model_transform()) {
-			prev_inverse_model_transform = get_inverse_model_transform();
+void vr_label_tool::update_slice(const float* pose, double time)
+{
+	VL_TIME_SCOPE(frame_timing::FS_COMPUTE_SLICE);
+	bool control_changed = false;
 
-			mat3 rotation;
+	vec3 down = -reinterpret_cast<const vec3&>(pose[3]);
+	vec3 origin = reinterpret_cast<const vec3&>(pose[9]);
+	origin += bottom_slice_distance * down;
 
-			for (size_t i = 0; i < 3; ++i) {
-				vec3 col(get_inverse_model_transform().col(i));
-				col.normalize();
+	VL_TRACE(trace::TC_INTERACTION, trace::TL_VERBOSE, "controller down " << down << " origin " << origin);
 
-				rotation.set_col(i, col);
-			}
+	if (prev_inverse_model_transform != get_inverse_model_transform()) {
+		prev_inverse_model_transform = get_inverse_model_transform();
+
+		mat3 rotation;
+
+		for (size_t i = 0; i < 3; ++i) {
+			vec3 col(get_inverse_model_transform().col(i));
+			col.normalize();
 
-			control_down_rotation = quat(rotation);
+			rotation.set_col(i, col);
 		}
 
-		vec4 origin4(get_inverse_model_transform() * origin.lift());
-		origin = origin4 / origin4.w();
+		control_down_rotation = quat(rotation);
+	}
 
-		control_down_rotation.rotate(down);
+	vec4 origin4(get_inverse_model_transform() * origin.lift());
+	origin = origin4 / origin4.w();
 
-#ifdef DEBUG
-		std::cout << "\ndown\t" << down;
-		std::cout << "\norigin\t" << origin << std::endl;
-#endif
+	control_down_rotation.rotate(down);
 
-		if (fabs(prev_control_down.x() - down.x()) > EPSILON ||
-			fabs(prev_control_down.y() - down.y()) > EPSILON ||
-			fabs(prev_control_down.z() - down.z()) > EPSILON ||
-			fabs(prev_control_origin.x() - origin.x()) > EPSILON ||
-			fabs(prev_control_origin.y() - origin.y()) > EPSILON ||
-			fabs(prev_control_origin.z() - origin.z()) > EPSILON)
-		{
-#ifdef DEBUG
-			std::cout << "\nprev down\t" << prev_control_down;
-			std::cout << "\nprev origin\t" << prev_control_origin << std::endl;
-#endif
+	VL_TRACE(trace::TC_INTERACTION, trace::TL_VERBOSE, "table down " << down << " origin " << origin);
 
-			control_changed = true;
-		}
+	slice_filter.apply(time, origin, down);
+
+	// controller jitter within the dead band around the pose of the temporary slice does not move it
+	float cos_angle = dot(prev_control_down, down) / (prev_control_down.length() * down.length());
+	if ((prev_control_origin - origin).length() > slice_position_dead_band ||
+		cos_angle < std::cos(slice_angle_dead_band * float(M_PI / 180)))
+	{
+		VL_TRACE(trace::TC_INTERACTION, trace::TL_DEBUG, "slice moved from down " << prev_control_down << " origin " << prev_control_origin);
 
-		prev_control_down = down;
-		prev_control_origin = origin;
+		control_changed = true;
+	}
 
-		if (control_changed)
-		{
-			labeler->delete_slice(temp_slice_idx);
-			labeler->create_slice(prev_control_origin, prev_control_down);
+	if (!control_changed && temp_slice_idx != -1)
+		return;
 
-			temp_slice_idx = labeler->get_num_slices() - 1;
-		}
+	// move the slice at most with the update rate and come back for the pending move
+	if (temp_slice_idx != -1 && slice_update_rate > 0 && time >= last_slice_update &&
+		(time - last_slice_update) * slice_update_rate < 1.0) {
+		post_redraw();
+		return;
+	}
+	last_slice_update = time;
+	prev_control_down = down;
+	prev_control_origin = origin;
+
+	// the temporary slice follows the controller in place and is not part of the undo history
+	if (temp_slice_idx == -1) {
+		if (labeler->create_slice(origin, down, false))
+			temp_slice_idx = int(labeler->get_num_slices()) - 1;
 	}
-};
+	else if (!labeler->set_slice(temp_slice_idx, origin, down))
+		// controller left the volume
+		remove_temp_slice();
+}
 
+void vr_label_tool::remove_temp_slice()
+{
+	if (temp_slice_idx == -1)
+		return;
+	labeler->delete_slice(temp_slice_idx, false);
+	temp_slice_idx = -1;
+}
 
-#include <cgv/base/register.h>
-cgv::base::object_registration<vr_label_tool> vr_label_tool_reg("vr_label_tool");
-#ifdef CGV_FORCE_STATIC
-cgv::base::registration_order_definition ro_def("vr_view_interactor;vr_emulator;vr_scene;vr_label_tool");
-#endif
+void vr_label_tool::select_slice()
+{
+	size_t index;
+	vec3 hit_point;
+	if (labeler->pick_slice(brush_ray_origin, brush_ray_direction, index, hit_point, temp_slice_idx == -1 ? SIZE_MAX : size_t(temp_slice_idx)))
+		selected_slice_idx = index;
+	else
+		selected_slice_idx = SIZE_MAX;
+	VL_TRACE(trace::TC_INTERACTION, trace::TL_INFO, "selected slice " << (selected_slice_idx == SIZE_MAX ? std::string("none") : std::to_string(selected_slice_idx)));
+}
+
+void vr_label_tool::compute_brush()
+{
+	brush_hit = false;
+	const vr::vr_kit_state* state_ptr = get_vr_state();
+	if (!state_ptr)
+		return;
+
+	vec3 direction = -reinterpret_cast<const vec3&>(state_ptr->controller[0].pose[6]);
+	vec3 origin = reinterpret_cast<const vec3&>(state_ptr->controller[0].pose[9]);
+
+	// transform ray to table coordinates, control_down_rotation is kept up to date by compute_slice
+	vec4 origin4(get_inverse_model_transform() * origin.lift());
+	origin = origin4 / origin4.w();
+	control_down_rotation.rotate(direction);
+	brush_ray_origin = origin;
+	brush_ray_direction = direction;
+
+	brush_hit = labeler->pick_slice_point(temp_slice_idx, origin, direction, brush_position);
+
+	bool pressed = state_ptr->controller[0].axes[2] > brush_trigger_threshold;
+	if (pressed && brush_hit) {
+		// samples are batched and rasterized once per frame by the labeler
+		labeler->add_stroke_sample(brush_position);
+		brushing = true;
+	}
+	else if (brushing) {
+		labeler->end_stroke();
+		brushing = false;
+	}
+	VL_TRACE(trace::TC_INTERACTION, trace::TL_VERBOSE, "brush " << (brush_hit ? "hit " : "miss ") << brush_position << (brushing ? " painting" : ""));
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cgv/base/group.h>
+#include <cgv/render/drawable.h>
+#include <cgv/gui/provider.h>
+
+#include <cg_nui/focusable.h>
+#include <cg_nui/transforming.h>
+#include <plugins/vr_lab/vr_tool.h>
+
+#include <cgv/math/ftransform.h>
+#include <cg_vr/vr_events.h>
+#include <chrono>
+#include <cgv_gl/surfel_renderer.h>
+
+#include "video_labeler.h"
+#include "frame_timing.h"
+#include "pose_trace.h"
+#include "pose_filter.h"
+#include "pressable.h"
+
+class vr_label_tool : 
+	public cgv::base::group,
+	public cgv::render::drawable,
+	public cgv::nui::focusable,
+	public cgv::nui::transforming,
+	public cgv::gui::provider,
+	public vr::vr_tool
+{
+	/// label index to show statistics
+	uint32_t li_stats; 
+	/// background color of statistics label
+	rgba stats_bgclr;
+	/// minimum time in seconds between updates of the statistics label text
+	float stats_refresh_interval = 0.25f;
+	/// version of the label statistics shown and time of the last update
+	uint32_t shown_stats_version = uint32_t(-1);
+	std::chrono::steady_clock::time_point last_stats_update;
+	/// number of most recent frames over which frame time percentiles are computed
+	uint32_t timing_window = 300;
+	/// whether frame timings are recorded and shown in the statistics label
+	bool record_timing = false;
+	/// base name of timing dumps, to which .csv and .json are appended
+	std::string timing_file_name = "frame_timing";
+	/// record vr states and controller keys of a session, or replay a recorded session instead of the live state;
+	/// the replayed state only drives this tool, i.e. slice, brush and controller keys, whereas the view, the nui
+	/// dispatcher and thereby grabbing and pointing of the labeler and pressables still follow the live devices
+	bool record_session = false;
+	bool replay_session = false;
+	/// replay at the speed of the recording instead of one sample per frame
+	bool replay_real_time = true;
+	std::string session_file_name = "session.vlpt";
+	pose_trace session;
+	pose_replayer replayer;
+	vr::vr_kit_state replay_state = {};
+	std::chrono::steady_clock::time_point record_start;
+	/// labels to show help on controllers
+	uint32_t li_help[2];
+	/// label for play button
+	uint32_t li_play = -1;
+	///
+	bool playback = false;
+
+	cgv::render::surfel_render_style surf_rs;
+public:
+	enum class tool_enum {
+		none,
+		slice
+	};
+
+	std::string get_type_name() const;
+	bool self_reflect(cgv::reflect::reflection_handler& rh);
+	/// transform point with pose to lab coordinate system 
+	vec3 compute_lab_draw_position(const float* pose, const vec3& p);
+	video_labeler_ptr labeler;
+	std::vector<pressable_ptr> buttons;
+
+protected:
+	// active tool 
+	tool_enum tool = tool_enum::slice;
+
+	// previous inverse model transform
+	// if this changes (e.g. the table is rotated), the quaternion for rotating control direction must be recalculated
+	mat4 prev_inverse_model_transform;
+	quat control_down_rotation;
+
+	// previous position and down direction of the right controller
+	vec3 prev_control_origin;
+	vec3 prev_control_down;
+
+	// slice
+	// index of temporary slice
+	int temp_slice_idx = -1;
+	size_t selected_slice_idx = SIZE_MAX;
+
+	// smoothing and prediction of the controller pose before the dead band
+	pose_filter slice_filter;
+
+	// minimum movement of the controller in table units and rotation in degrees to move the temporary slice
+	float slice_position_dead_band = 0.001f;
+	float slice_angle_dead_band = 0.25f;
+	// maximum number of temporary slice moves per second or 0 for one per frame
+	float slice_update_rate = 60.0f;
+	double last_slice_update = 0;
+
+	// distance from front and bottom slices to the controller
+	float front_slice_distance = 0.075f;
+	float bottom_slice_distance = 0.085f;
+
+	// brush
+	// trigger value of the left controller above which the brush paints
+	float brush_trigger_threshold = 0.5f;
+	bool brushing = false;
+	// brush position on the temporary slice in table coordinates
+	bool brush_hit = false;
+	vec3 brush_position;
+	// ray of the left controller in table coordinates, used for brushing and selecting slices
+	vec3 brush_ray_origin = vec3(0.0f);
+	vec3 brush_ray_direction = vec3(0.0f, 0.0f, -1.0f);
+
+public:
+	vr_label_tool();
+	void on_pressed(unsigned i);
+	void on_set(void* member_ptr);
+	/// show statistics of the current label once they changed, but not more often than the refresh interval
+	void update_stats_label(vr::vr_scene* scene_ptr);
+	/// write recorded frame timings as csv or as chrome trace json for chrome://tracing
+	void write_timing(bool chrome_trace);
+	void clear_timing();
+	/// state of the replayed session or else the current state of the vr kit
+	const vr::vr_kit_state* get_vr_state();
+	/// advance the replayed session by one frame and dispatch its key events as if they came from the controllers
+	void replay_frame();
+	/// clock in seconds of the slice filter and update rate, which is the time of the replayed sample during a replay
+	/// such that replays that do not run in real time give the same slices
+	double get_slice_time() const;
+	double get_record_time() const;
+	bool init(cgv::render::context& ctx);
+	void init_frame(cgv::render::context& ctx);
+	void clear(cgv::render::context& ctx);
+	void draw(cgv::render::context& ctx);
+	void finish_draw(cgv::render::context& ctx);
+	void draw_circle(cgv::render::context& ctx, const vec3& position, const vec3& normal);
+	void draw_brush(cgv::render::context& ctx, const vec3& position, const vec3& normal);
+	void stream_help(std::ostream& os);
+
+	bool focus_change(cgv::nui::focus_change_action action, cgv::nui::refocus_action rfa, const cgv::nui::focus_demand& demand, const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info);
+	/// undo and redo label and slice edits with the dpad of the left controller and store the held slice with the dpad of
+	/// the right controller, called for live and replayed keys
+	bool handle_controller_key(int controller_index, unsigned short key, cgv::gui::KeyAction action);
+	bool handle(const cgv::gui::event& e);
+	bool handle(const cgv::gui::event& e, const cgv::nui::dispatch_info& dis_info, cgv::nui::focus_request& request);
+	void create_gui();
+
+	void compute_slice();
+
+	/// place temporary slice below the right controller with the given 3x4 pose in lab coordinates
+	void update_slice(const float* pose, double time);
+
+	void remove_temp_slice();
+
+	// select closest stored slice hit by the ray of the left controller
+	void select_slice();
+
+	// point with left controller onto temporary slice and paint while trigger is pressed
+	void compute_brush();
+};
+
@@ -0,0 +1,7 @@
+#include "vr_label_tool.h"
+
+#include <cgv/base/register.h>
+cgv::base::object_registration<vr_label_tool> vr_label_tool_reg("vr_label_tool");
+#ifdef CGV_FORCE_STATIC
+cgv::base::registration_order_definition ro_def("vr_view_interactor;vr_emulator;vr_scene;vr_label_tool");
+#endif